@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <opencv2/core/core_c.h>
+#include "libxkin.h"
 
 typedef struct ptseq{
 	CvSeq *ptr;
@@ -41,6 +42,8 @@ typedef struct CvHMM {
 CvHMM       cvhmm_from_gesture_proto     (const char *infile);
 int         cvhmm_classify_gesture       (CvHMM *mo, int num, ptseq seq, FILE *pf);
 int         cvhmm_get_gesture_sequence   (int posture, CvPoint pt, ptseq *seq);
+int         cvhmm_get_gesture_sequence_ctx (xkin_ctx *ctx, int posture,
+					    CvPoint pt, ptseq *seq);
 CvHMM       cvhmm_blr_init               (int N, int M, double pii, double pij);
 void        cvhmm_free                   (CvHMM mo);
 void        cvhmm_print                  (CvHMM mo);
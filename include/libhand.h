@@ -5,11 +5,29 @@
 extern "C" {
 #endif
 
+#include "libxkin.h"
+
 IplImage*      hand_detection                (IplImage*,int*);
 int            get_hand_contour_basic        (IplImage*, CvSeq**, CvPoint*);
 int            get_hand_contour_advanced     (IplImage*, IplImage*, int,
 					      CvSeq**, CvPoint*);
 
+IplImage*      hand_detection_ctx            (xkin_ctx*, IplImage*, CvRect*,
+					      int*);
+int            get_hand_contour_basic_ctx    (xkin_ctx*, IplImage*, CvRect*,
+					      xkin_contour**, CvPoint*);
+int            get_hand_contour_advanced_ctx (xkin_ctx*, IplImage*, IplImage*,
+					      int, CvRect*, xkin_contour**,
+					      CvPoint*);
+
+int            hand_registration_load        (const char*);
+int            hand_registration_load_ctx    (xkin_ctx*, const char*);
+void           hand_map_contour_ctx          (xkin_ctx*, xkin_contour*, int,
+					      xkin_contour*);
+int            hand_map_mask_ctx             (xkin_ctx*, IplImage*, CvRect*,
+					      int, IplImage*);
+void           hand_skin_lut_ctx             (xkin_ctx*, const unsigned char*);
+
 void           draw_detected_hand             (CvSeq*,CvPoint,int);
 void           draw_contour                   (CvSeq*); 
 /* void           draw_point_sequence            (CvSeq*); */
@@ -1,6 +1,8 @@
 #ifndef _LIBPOSTURE_H_
 #define _LIBPOSTURE_H_
 
+#include "libxkin.h"
+
 enum {
         FD_NUM=8
 };
@@ -11,11 +13,38 @@ typedef struct CvPostModel {
 	CvMat *cov;
 } CvPostModel;
 
+typedef struct CvPostModelSet {
+	int num;
+	int pairs;
+	int *type;
+	double *data;
+} CvPostModelSet;
+
 
 CvMat*         get_fourier_descriptors           (CvSeq*);
 int            basic_posture_classification      (CvSeq*);
 int            advanced_posture_classification   (CvSeq*,CvPostModel*,int);
 
+CvMat*         get_fourier_descriptors_ctx       (xkin_ctx*,xkin_contour*);
+int            basic_posture_classification_ctx  (xkin_ctx*,xkin_contour*);
+int            advanced_posture_classification_ctx (xkin_ctx*,xkin_contour*,
+						    CvPostModel*,int);
+
+int            advanced_posture_classification_set (CvSeq*,CvPostModelSet*,
+						    double*);
+int            advanced_posture_classification_set_ctx (xkin_ctx*,
+							xkin_contour*,
+							CvPostModelSet*,
+							double*);
+
+CvPostModelSet* posture_models_compile           (CvPostModel*,int);
+void           posture_models_release            (CvPostModelSet**);
+int            posture_models_classify           (CvPostModelSet*,CvMat*,
+						  double*);
+
+int            posture_fft_init                  (const char*,int);
+int            posture_fft_init_ctx              (xkin_ctx*,const char*,int);
+
 #endif /* _LIBPOSTURE_H_ */
 
 
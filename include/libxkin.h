@@ -0,0 +1,365 @@
+#ifndef _LIBXKIN_H_
+#define _LIBXKIN_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <opencv2/core/core_c.h>
+#include <opencv2/imgproc/imgproc_c.h>
+
+enum {
+	XKIN_BUFFLEN=5,
+	XKIN_MAX_THREADS=16,
+	XKIN_MAX_USERS=8,
+	XKIN_WARMUP_FRAMES=30,
+	XKIN_REG_TABLES=4,
+	XKIN_VOTE_WINDOW=64
+};
+
+/*!
+ * \brief Depth resolution used by body and hand detection.
+ */
+enum {
+	XKIN_DEPTH_8BIT=0,       //!< depth scaled to 8 bit (default)
+	XKIN_DEPTH_NATIVE=1      //!< native 11 bit kinect depth
+};
+
+/*!
+ * \brief Hand depth clustering method.
+ */
+enum {
+	XKIN_CLUSTER_LLOYD=0,    //!< 2-means (Lloyd) on the depth histogram (default)
+	XKIN_CLUSTER_OTSU=1,     //!< exact 2 class Otsu on the depth histogram
+	XKIN_CLUSTER_ONLINE=2    //!< original online k-means, pixel by pixel
+};
+
+/*!
+ * \brief Hand mask smoothing implementation.
+ */
+enum {
+	XKIN_MORPH_PACKED=0,     //!< bit packed mask, fused median/open/close (default)
+	XKIN_MORPH_OPENCV=1      //!< opencv median and morphology on bytes
+};
+
+/*!
+ * \brief Posture descriptors spectrum implementation.
+ */
+enum {
+	XKIN_FD_FFTW=0,          //!< full FFT (default, if built with FFTW)
+	XKIN_FD_DIRECT=1         //!< direct DFT of the used bins only
+};
+
+/*!
+ * \brief FFTW planning effort of the posture descriptors.
+ */
+enum {
+	XKIN_FFT_MEASURE=0,      //!< FFTW_MEASURE (default)
+	XKIN_FFT_PATIENT=1       //!< FFTW_PATIENT
+};
+
+/*!
+ * \brief Color hand segmentation implementation.
+ */
+enum {
+	XKIN_SEG_LUT=0,          //!< color table on the source, box filter (default)
+	XKIN_SEG_OPENCV=1        //!< opencv YCrCb conversion and filters
+};
+
+/*!
+ * \brief Filters of XKIN_SEG_OPENCV color segmentation.
+ */
+enum {
+	XKIN_SMOOTH_FAST=0,      //!< fixed point Gaussian, constant time median (default)
+	XKIN_SMOOTH_OPENCV=1     //!< cvSmooth
+};
+
+#define XKIN_BODY_MIN_AREA      0.15
+
+/*!
+ * \brief Fixed size worker pool (see xkin_ctx_set_threads).
+ */
+typedef struct xkin_pool xkin_pool;
+
+/*!
+ * \brief Pool job, called with the job index.
+ */
+typedef void (*xkin_task) (void*, int);
+
+/*!
+ * \brief Body found by body_detection_multi.
+ */
+typedef struct xkin_user {
+	int label;               //!< value of the user pixels in the label image
+	int interval[2];         //!< depth interval (histogram bins)
+	float area;              //!< area (image fraction)
+	CvRect roi;              //!< bounding box
+} xkin_user;
+
+/*!
+ * \brief Body detection state.
+ */
+typedef struct xkin_body {
+	IplImage *body;          //!< body depth image (output, 8 or 16 bit)
+	IplImage *tmp;           //!< 8 bit depth image
+	float min_area;          //!< minimum body area (image fraction)
+	int decimation;          //!< coarse search decimation (2 or 4, 0 off)
+	int track_period;        //!< frames between interval recomputations (0 off)
+	CvRect roi;              //!< body bounding box (output)
+	int interval[2];         //!< tracked body interval
+	int tracked;             //!< tracked interval is valid
+	int age;                 //!< frames since the last recomputation
+	unsigned int hits;       //!< frames served by the tracked interval
+	unsigned int misses;     //!< tracked interval rejected by validation
+	int bg_warmup;           //!< background learning frames (0 no model)
+	int bg_period;           //!< frames between background updates (0 never)
+	int bg_frames;           //!< frames seen by the background model
+	IplImage *bg_min;        //!< background minimum depth (16 bit)
+	IplImage *bg_max;        //!< background maximum depth (16 bit)
+	IplImage *fg;            //!< depth image without background (16 bit)
+	IplImage *coarse;        //!< decimated depth image
+	CvRect mask_roi;         //!< region written in the body image
+	unsigned int *tiles;     //!< per tile histograms
+	IplImage *labels;        //!< user label image (multi user output)
+	IplImage *user;          //!< single user depth image (multi user output)
+	CvRect user_roi;         //!< region written in the user image
+} xkin_body;
+
+/*!
+ * \brief Bit packed binary mask, 64 pixels per word.
+ *
+ * Bit j of word w in a row is the pixel x = 64*w + j, the bits past
+ * the width are zero.
+ */
+typedef struct xkin_bitmask {
+	uint64_t *bits;          //!< rows of stride words
+	int width;               //!< width in pixels
+	int height;              //!< height in pixels
+	int stride;              //!< words per row
+	size_t capacity;         //!< allocated words
+	uint64_t *scratch;       //!< smoothing rows
+	int scratch_stride;      //!< row length of the smoothing rows
+} xkin_bitmask;
+
+/*!
+ * \brief Contour as flat arrays of coordinates.
+ *
+ * Point i is (x[i], y[i]). The buffers are owned by the contour and
+ * reused, see xkin_contour_reserve.
+ */
+typedef struct xkin_contour {
+	int *x;                  //!< x coordinates
+	int *y;                  //!< y coordinates
+	int num;                 //!< number of points
+	int capacity;            //!< allocated points
+} xkin_contour;
+
+/*!
+ * \brief Raw moments of a binary mask.
+ */
+typedef struct xkin_moments {
+	double m00;              //!< area
+	double m10;              //!< sum of x
+	double m01;              //!< sum of y
+	CvRect bbox;             //!< bounding box (empty if no pixel)
+} xkin_moments;
+
+/*!
+ * \brief Connected component of the hand mask.
+ */
+typedef struct xkin_blob {
+	int area;                //!< number of pixels
+	CvRect bbox;             //!< bounding box
+	CvPoint2D32f centroid;   //!< centroid
+} xkin_blob;
+
+/*!
+ * \brief Depth to color registration.
+ *
+ * Calibration of the two kinect cameras (default values, or loaded
+ * with hand_registration_load_ctx) and lookup tables for the depths
+ * mapped recently. For a depth z a color point is
+ * x = (xu[u] + xv[v]) / (wu[u] + wv[v]), and the same for y, where
+ * the per column and per row terms fold projections, rotation and
+ * translation.
+ */
+typedef struct xkin_registration {
+	int loaded;              //!< calibration is set
+	double depth[4];         //!< depth camera fx, fy, cx, cy
+	double rgb[4];           //!< color camera fx, fy, cx, cy
+	double R[9];             //!< depth to color rotation
+	double T[3];             //!< depth to color translation (m)
+	int z[XKIN_REG_TABLES];  //!< depth (mm) of each table, 0 empty
+	double *lut[XKIN_REG_TABLES]; //!< per column and per row terms
+	int next;                //!< next table to replace
+} xkin_registration;
+
+/*!
+ * \brief Hand tracking state.
+ *
+ * The hand box moves with constant velocity, corrected by the measured
+ * box with fixed gains (alpha-beta filter, the steady state Kalman
+ * filter of this model).
+ */
+typedef struct xkin_hand_track {
+	int valid;               //!< state of the last frame is set
+	float x, y;              //!< hand box centre
+	float vx, vy;            //!< hand box velocity (pixels per frame)
+	float w, h;              //!< hand box size
+	int area;                //!< hand mask area
+	int thrs[2];             //!< hand depth interval
+	int dmin;                //!< nearest depth in the hand box
+	int age;                 //!< frames since the last full detection
+	unsigned int hits;       //!< frames detected in the predicted window
+	unsigned int misses;     //!< predictions rejected (hand lost)
+} xkin_hand_track;
+
+/*!
+ * \brief Posture temporal voter.
+ *
+ * The last window classifications are kept in a ring together with
+ * the per class vote counts (or confidence sums), updated by one vote
+ * in and one out per frame. The scores are sized by the number of
+ * classes of the classification. Setting window or weighted restarts
+ * the voter.
+ */
+typedef struct xkin_voter {
+	int window;              //!< window length (0: XKIN_BUFFLEN, max XKIN_VOTE_WINDOW)
+	int weighted;            //!< weight votes by classification confidence
+	int len;                 //!< window length in use
+	int mode;                //!< weighting in use
+	int head;                //!< oldest vote
+	int count;               //!< votes in the window
+	int classes;             //!< classes seen
+	int capacity;            //!< score length
+	int leader;              //!< class with the highest score
+	int votes[XKIN_VOTE_WINDOW];     //!< vote ring
+	double weight[XKIN_VOTE_WINDOW]; //!< vote weight ring
+	double *score;           //!< per class score
+} xkin_voter;
+
+/*!
+ * \brief Hand detection and contour extraction state.
+ */
+typedef struct xkin_hand {
+	IplImage *hand;          //!< binary hand image (output)
+	IplImage *work;          //!< copy of the hand image (advanced contour)
+	IplConvKernel *strel;    //!< morphology structuring element
+	CvMemStorage *storage;   //!< contours storage
+	CvRect roi;              //!< region written in the hand image
+	int clustering;          //!< hand depth clustering method
+	int morphology;          //!< mask smoothing implementation
+	xkin_bitmask mask;       //!< packed hand mask
+	int mask_valid;          //!< mask holds the hand image region roi
+	xkin_moments moments;    //!< moments of the hand image region roi
+	xkin_blob blob;          //!< hand blob (largest of the mask)
+	xkin_contour contour;    //!< hand contour (output)
+	xkin_registration reg;   //!< depth to color registration
+	int registered;          //!< gate color segmentation with the depth mask
+	int segmentation;        //!< color segmentation implementation
+	int smoothing;           //!< color segmentation filters
+	unsigned char *skin_lut; //!< color classification table
+	int skin_thresh;         //!< color threshold of the last frame (0 none)
+	int track_period;        //!< frames between full detections (0 no tracking)
+	xkin_hand_track track;   //!< hand tracking state
+} xkin_hand;
+
+/*!
+ * \brief Posture classification state.
+ */
+typedef struct xkin_posture {
+	CvMemStorage *poly;      //!< polygon approximation storage
+	CvMemStorage *hull;      //!< convex hull storage
+	CvMemStorage *defects;   //!< convexity defects storage
+	xkin_contour input;      //!< contour given as a sequence
+	CvMat *desc;             //!< fourier descriptors (output)
+	void *fft;               //!< descriptor engine (see fourierdesc.c)
+	void (*fft_free)(void*); //!< descriptor engine destructor
+	int descriptors;         //!< descriptors spectrum implementation
+	xkin_voter basic;        //!< open/close classification voter
+	xkin_voter advanced;     //!< model classification voter
+} xkin_posture;
+
+/*!
+ * \brief Gesture sequence state machine.
+ */
+typedef struct xkin_gesture {
+	int state;
+	int count;
+	int miss;
+	int tot;
+	CvPoint prev;
+} xkin_gesture;
+
+/*!
+ * \brief Frame memory (see xkin_alloc).
+ */
+typedef struct xkin_arena {
+	char *base;              //!< arena memory
+	size_t size;             //!< arena size
+	size_t used;             //!< bytes used in the current frame
+	size_t peak;             //!< bytes used by the largest frame
+	void *extra;             //!< overflow blocks of the current frame
+} xkin_arena;
+
+/*!
+ * \brief Pipeline context.
+ *
+ * A context holds every working buffer and state of the processing
+ * chain for one stream. Buffers are created on the first frame and
+ * reused afterwards, different contexts can be used concurrently from
+ * different threads.
+ *
+ * With depth_mode set to XKIN_DEPTH_NATIVE the body image is 16 bit
+ * with raw kinect values and the hand depth is in millimetres.
+ *
+ * When a worker pool is set (xkin_ctx_set_threads) the body stage
+ * splits the frame into row tiles processed in parallel.
+ *
+ * Per frame scratch memory comes from the arena, which is reset by
+ * xkin_ctx_frame (called by hand_detection_ctx). allocs counts the
+ * heap allocations done for the context, after XKIN_WARMUP_FRAMES
+ * frames it should change only when the frame memory grows.
+ */
+typedef struct xkin_ctx {
+	int depth_mode;
+	xkin_pool *pool;         //!< worker pool, NULL for single thread
+	xkin_arena arena;        //!< frame memory
+	unsigned long allocs;    //!< heap allocations
+	unsigned long allocs_mark; //!< heap allocations at frame start
+	unsigned long frames;    //!< frames started
+	xkin_body body;
+	xkin_hand hand;
+	xkin_posture posture;
+	xkin_gesture gesture;
+} xkin_ctx;
+
+xkin_ctx*      xkin_ctx_create       (void);
+void           xkin_ctx_free         (xkin_ctx*);
+xkin_ctx*      xkin_default_ctx      (void);
+int            xkin_ctx_set_threads  (xkin_ctx*, int);
+void           xkin_ctx_frame        (xkin_ctx*);
+
+void*          xkin_alloc            (xkin_ctx*, size_t);
+IplImage*      xkin_alloc_image      (xkin_ctx*, CvSize, int, int);
+IplImage*      xkin_image            (xkin_ctx*, IplImage**, CvSize, int, int);
+void           xkin_arena_free       (xkin_arena*);
+
+int            xkin_contour_reserve  (xkin_contour*, int);
+int            xkin_contour_from_seq (xkin_contour*, CvSeq*);
+CvSeq*         xkin_contour_to_seq   (xkin_contour*, CvMemStorage*);
+void           xkin_contour_points   (xkin_contour*, CvPoint*);
+CvRect         xkin_contour_bbox     (xkin_contour*);
+void           xkin_contour_free     (xkin_contour*);
+
+xkin_pool*     xkin_pool_create      (int);
+void           xkin_pool_free        (xkin_pool*);
+int            xkin_pool_size        (xkin_pool*);
+void           xkin_pool_run         (xkin_pool*, xkin_task, void*, int);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _LIBXKIN_H_ */
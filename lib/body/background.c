@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file background.c
+ * \author Fabrizio Pedersoli
+ *
+ * Static background depth model. With a fixed camera, walls and
+ * furniture can fall in the same histogram support of the body. The
+ * model learns for every pixel the depth range of the scene and removes
+ * it from the depth image before the body histogram is computed.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <opencv2/core/core_c.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libxkin.h"
+#include "const.h"
+#include "background.h"
+
+
+static void        learn_row          (const uint16_t*, uint16_t*, uint16_t*, int);
+static void        update_row         (const uint16_t*, uint16_t*, uint16_t*, int);
+static void        reject_row         (const uint16_t*, const uint16_t*, const uint16_t*, uint16_t*, int);
+
+
+/*!
+ * \brief Remove the background from the depth image.
+ *
+ * During the first s->bg_warmup frames the per pixel minimum and
+ * maximum depth are learned and the depth image is returned as it is
+ * (the scene should be empty). Afterwards every pixel within the
+ * learned range (BG_TOL tolerance) is set to 0. Unlike the "no
+ * reading" value, which is left out of the histogram total, 0 is
+ * counted but never part of a depth support: areas stay normalized by
+ * all the pixels with a depth reading, so on an empty scene a few
+ * noisy pixels are not taken for a body. Every s->bg_period frames
+ * (0 never) the range of the background pixels is widened by one step
+ * toward the current depth, see update_row.
+ *
+ * \param[in]  body state
+ * \param[in]  depth image (16 bit, 1 channel)
+ * \return     foreground depth image (owned by the body state)
+ */
+IplImage *background_filter (xkin_body *s, IplImage *depth)
+{
+	int i, update;
+
+	if (s->bg_min == NULL) {
+		s->bg_min = cvCreateImage(cvGetSize(depth), IPL_DEPTH_16U, 1);
+		s->bg_max = cvCreateImage(cvGetSize(depth), IPL_DEPTH_16U, 1);
+		s->fg = cvCreateImage(cvGetSize(depth), IPL_DEPTH_16U, 1);
+		s->bg_frames = 0;
+	}
+
+	if (s->bg_frames == 0) {
+		cvSet(s->bg_min, cvScalarAll(NBINS_NATIVE-1), NULL);
+		cvZero(s->bg_max);
+	}
+
+	if (s->bg_frames < s->bg_warmup) {
+		for (i=0; i<depth->height; i++) {
+			learn_row((uint16_t*)(depth->imageData + i*depth->widthStep),
+				  (uint16_t*)(s->bg_min->imageData + i*s->bg_min->widthStep),
+				  (uint16_t*)(s->bg_max->imageData + i*s->bg_max->widthStep),
+				  depth->width);
+		}
+		s->bg_frames++;
+		return depth;
+	}
+
+	update = s->bg_period > 0 &&
+		(s->bg_frames - s->bg_warmup) % s->bg_period == s->bg_period-1;
+
+	for (i=0; i<depth->height; i++) {
+		uint16_t *src = (uint16_t*)(depth->imageData + i*depth->widthStep);
+		uint16_t *min = (uint16_t*)(s->bg_min->imageData + i*s->bg_min->widthStep);
+		uint16_t *max = (uint16_t*)(s->bg_max->imageData + i*s->bg_max->widthStep);
+		uint16_t *dst = (uint16_t*)(s->fg->imageData + i*s->fg->widthStep);
+
+		reject_row(src, min, max, dst, depth->width);
+		if (update)
+			update_row(src, min, max, depth->width);
+	}
+	s->bg_frames++;
+
+	return s->fg;
+}
+
+/*!
+ * \brief Extend the background range with a depth row.
+ */
+static void learn_row (const uint16_t *src, uint16_t *min, uint16_t *max, int n)
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		uint16_t v = src[i];
+
+		if (v >= NBINS_NATIVE-1)
+			continue;
+		if (v < min[i])
+			min[i] = v;
+		if (v > max[i])
+			max[i] = v;
+	}
+}
+
+/*!
+ * \brief Slow update of the background range.
+ *
+ * Only background pixels (within the range and its BG_TOL tolerance)
+ * are used: a bound moves one step only when the current depth is
+ * outside of it, min down and max up, so the range follows small
+ * drifts of the scene. The range never shrinks.
+ */
+static void update_row (const uint16_t *src, uint16_t *min, uint16_t *max, int n)
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		int v = src[i];
+
+		if (v >= NBINS_NATIVE-1 || v+BG_TOL < min[i] || v > max[i]+BG_TOL)
+			continue;
+		if (v < min[i])
+			min[i]--;
+		if (v > max[i])
+			max[i]++;
+	}
+}
+
+/*!
+ * \brief Set the background pixels of a row to 0.
+ *
+ * dst = (min-BG_TOL <= src <= max+BG_TOL) ? 0 : src
+ */
+static void reject_row (const uint16_t *src, const uint16_t *min,
+			const uint16_t *max, uint16_t *dst, int n)
+{
+	int i=0;
+
+#if defined(__SSE2__)
+	const __m128i tol = _mm_set1_epi16(BG_TOL);
+
+	/* depth values are below 2^15: signed compares are safe */
+	for (; i+8<=n; i+=8) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(src+i));
+		__m128i lo = _mm_loadu_si128((const __m128i*)(min+i));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(max+i));
+		__m128i out;
+
+		lo = _mm_subs_epi16(lo, tol);
+		hi = _mm_adds_epi16(hi, tol);
+		out = _mm_or_si128(_mm_cmplt_epi16(v, lo), _mm_cmpgt_epi16(v, hi));
+		v = _mm_and_si128(out, v);
+		_mm_storeu_si128((__m128i*)(dst+i), v);
+	}
+#endif
+	for (; i<n; i++) {
+		int v = src[i];
+
+		dst[i] = (v+BG_TOL >= min[i] && v <= max[i]+BG_TOL) ? 0 : v;
+	}
+}
@@ -0,0 +1,6 @@
+#ifndef _BACKGROUND_H_
+#define _BACKGROUND_H_
+
+IplImage*        background_filter       (xkin_body*, IplImage*);
+
+#endif /* _BACKGROUND_H_ */
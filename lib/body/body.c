@@ -42,142 +42,907 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 #include <opencv2/core/core_c.h>
 #include <opencv2/imgproc/imgproc_c.h>
 
+#include "libxkin.h"
 #include "const.h"
 #include "visualiz.h"
+#include "quantize.h"
+#include "cumhist.h"
+#include "background.h"
 #include "body.h"
 
 
-static CvHistogram*       get_depth_histogram          (IplImage*);
-static void               get_body_depth_interval      (CvHistogram*, int, int*);
-static float              get_interval_area            (CvHistogram *, int*);
-static void               get_body_image               (IplImage*, IplImage*, int*);
+/*!
+ * \brief Row tiles of a frame processed by the worker pool.
+ */
+typedef struct body_tiles {
+	IplImage *depth;                //!< input depth image
+	IplImage *img;                  //!< 8 bit depth image (NULL if native)
+	IplImage *body;                 //!< body depth image
+	unsigned int *hist;             //!< per tile histograms
+	int *interval;                  //!< body depth interval
+	int quantize;                   //!< quantize the depth while masking
+	int num;                        //!< number of tiles
+	int bb[XKIN_MAX_THREADS][4];    //!< per tile bounding boxes
+} body_tiles;
+
+
+static void               create_images                (xkin_body*, IplImage*, int);
+static void               clear_body                   (xkin_body*);
+static IplImage*          body_detection_pyramid       (xkin_ctx*, IplImage*, int);
+static int                track_interval               (xkin_body*, IplImage*, int);
+static float              band_area                    (cumhist*, int, int);
+static void               coarse_bbox                  (IplImage*, int, int*);
+static void               body_histogram               (xkin_ctx*, IplImage*, int, unsigned int*);
+static CvRect             body_mask                    (xkin_ctx*, IplImage*, int, int*, int);
+static void               tile_hist                    (void*, int);
+static void               tile_mask                    (void*, int);
+static int                get_body_depth_interval      (cumhist*, int, float, int*);
+static void               get_body_image               (IplImage*, IplImage*, int*, CvRect, int*);
+static void               get_body_image_native        (IplImage*, IplImage*, int*, CvRect, int*);
+static void               get_body_image_quantize      (IplImage*, IplImage*, int*, CvRect, int*);
+static void               label_users                  (IplImage*, IplImage*, IplImage*, uint8_t*, int, xkin_user*, int);
+static void               update_bbox                  (int, int, int, int*);
+static CvRect             bbox_rect                    (int*);
 
 
 /*!
  * \brief Detect the body in depth image.
  *
  * It takes the depth image produced by kinect and return a new depth
- * image which presents only body depth values.
+ * image which presents only body depth values. This uses the default
+ * (process wide) context, see body_detection_ctx.
  *  
  * \param[in]   depth image
- * \param[out]  body depth image
+ * \return      body depth image, NULL if there is no body
  */
 IplImage *body_detection (IplImage *depth)
 {
-	CvHistogram *hist;
-	int interval[2], start=1;
-	float area=0;
-	static IplImage *body=NULL;
-	static IplImage *tmp=NULL;
+	return body_detection_ctx(xkin_default_ctx(), depth);
+}
+
+/*!
+ * \brief Detect the body in depth image using a pipeline context.
+ *
+ * Same as body_detection, the returned image is owned by the context
+ * and it is overwritten by the next call. The body is the nearest
+ * depth support whose area is at least ctx->body.min_area. The body
+ * bounding box is stored in ctx->body.roi, the hand functions can
+ * use it to avoid scanning the whole frame. When there is no body
+ * the body image is cleared and ctx->body.roi is empty.
+ *
+ * In XKIN_DEPTH_NATIVE mode the histogram has one bin per kinect
+ * depth value and the body image is 16 bit, no 8 bit conversion is
+ * done.
+ *
+ * If the context has a worker pool the frame is split into row tiles:
+ * each tile computes its own histogram, the histograms are merged and
+ * the tiles are masked in parallel.
+ *
+ * With ctx->body.decimation set to 2 or 4 the body interval is searched
+ * on a decimated image and only the body region is masked at full
+ * resolution (see body_detection_pyramid).
+ *
+ * With ctx->body.track_period > 0 the body interval of the previous
+ * frame is reused as long as it is confirmed by a sparse sample of the
+ * frame (see track_interval); the full histogram is computed only
+ * when the check fails or every track_period frames. ctx->body.hits and
+ * ctx->body.misses count the reused and the rejected intervals.
+ * Tracking is not used together with decimation.
+ *
+ * With ctx->body.bg_warmup > 0 a static background model is learned
+ * on the first bg_warmup frames and then removed from every frame
+ * before the body histogram (see background_filter).
+ *
+ * \param[in]   pipeline context
+ * \param[in]   depth image
+ * \return      body depth image, NULL if there is no body
+ */
+IplImage *body_detection_ctx (xkin_ctx *ctx, IplImage *depth)
+{
+	xkin_body *s = &(ctx->body);
+	unsigned int hist[NBINS_NATIVE];
+	int interval[2], native = (ctx->depth_mode == XKIN_DEPTH_NATIVE);
+	cumhist c;
+
+	create_images(s, depth, native);
+
+	if (s->bg_warmup > 0)
+		depth = background_filter(s, depth);
+
+	if (s->decimation > 1)
+		return body_detection_pyramid(ctx, depth, native);
+
+	if (s->track_period > 0 && s->tracked && s->age < s->track_period) {
+		if (track_interval(s, depth, native)) {
+			s->hits++;
+			s->age++;
+			s->roi = body_mask(ctx, depth, native, s->interval, 1);
+			s->mask_roi = cvRect(0, 0, depth->width, depth->height);
+			return s->body;
+		}
+		s->misses++;
+	}
+
+	body_histogram(ctx, depth, native, hist);
+	cumhist_build(&c, hist, native ? NBINS_NATIVE : NBINS);
+
+	if (!get_body_depth_interval(&c, native ? NATIVE_GAP : 1,
+				     s->min_area, interval)) {
+		clear_body(s);
+		return NULL;
+	}
+
+	s->interval[0] = interval[0];
+	s->interval[1] = interval[1];
+	s->tracked = 1;
+	s->age = 0;
+
+	s->roi = body_mask(ctx, depth, native, interval, 0);
+	s->mask_roi = cvRect(0, 0, depth->width, depth->height);
+
+	return s->body;
+}
+
+/*!
+ * \brief Check the tracked body interval on a sparse sample.
+ *
+ * The interval is still valid if, on one pixel every TRACK_STEP, it
+ * covers at least the minimum body area, the bins just outside it are
+ * (almost) empty, i.e. the body has not moved out of the interval, and
+ * there is not enough nearer mass to hide a new nearer body.
+ *
+ * \param[in]  body state
+ * \param[in]  depth image
+ * \param[in]  native depth mode
+ * \return     1 if the interval is still valid, 0 otherwise
+ */
+static int track_interval (xkin_body *s, IplImage *depth, int native)
+{
+	unsigned int hist[NBINS_NATIVE];
+	int min = s->interval[0], max = s->interval[1];
+	int g = native ? TRACK_GUARD_NATIVE : TRACK_GUARD;
+	cumhist c;
+
+	depth_sample_hist(depth, hist, TRACK_STEP, native);
+	cumhist_build(&c, hist, native ? NBINS_NATIVE : NBINS);
+
+	if (band_area(&c, min, max) < s->min_area)
+		return 0;
+	if (band_area(&c, min-g, min-1) + band_area(&c, max+1, max+g) >
+	    TRACK_GUARD_AREA)
+		return 0;
+	if (band_area(&c, 1, min-g-1) >= s->min_area)
+		return 0;
+
+	return 1;
+}
 
-	if (body==NULL && tmp==NULL) {
-		body = cvCreateImage(cvGetSize(depth), 8, 1);
-                tmp = cvCreateImage(cvGetSize(depth), 8, 1);
+/*!
+ * \brief cumhist_area with the interval clipped to the valid bins.
+ */
+static float band_area (cumhist *c, int min, int max)
+{
+	if (min < 1)
+		min = 1;
+	if (max > c->nbins-2)
+		max = c->nbins-2;
+
+	return cumhist_area(c, min, max);
+}
+
+/*!
+ * \brief Coarse to fine body detection.
+ *
+ * The histogram and the body interval are computed on the depth image
+ * decimated by ctx->body.decimation (the decimation is done by the
+ * conversion pass). The body bounding box found on the coarse image,
+ * enlarged by one coarse pixel, is the only region masked at full
+ * resolution, the rest of the body image is zero. Body parts thinner
+ * than the decimation step can be lost.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[in]   native depth mode
+ * \return      body depth image, NULL if there is no body
+ */
+static IplImage *body_detection_pyramid (xkin_ctx *ctx, IplImage *depth,
+					 int native)
+{
+	xkin_body *s = &(ctx->body);
+	unsigned int hist[NBINS_NATIVE];
+	int interval[2], d = s->decimation;
+	int bb[4] = {depth->width, depth->height, -1, -1};
+	CvSize size = cvSize((depth->width+d-1)/d, (depth->height+d-1)/d);
+	int x0, y0, x1, y1;
+	cumhist c;
+	CvRect r;
+
+	if (s->coarse!=NULL && (s->coarse->width!=size.width ||
+				s->coarse->height!=size.height ||
+				s->coarse->depth!=s->body->depth))
+		cvReleaseImage(&(s->coarse));
+	if (s->coarse==NULL)
+		s->coarse = cvCreateImage(size, s->body->depth, 1);
+
+	if (native) {
+		depth_decimate_hist_native(depth, s->coarse, hist, d);
+		cumhist_build(&c, hist, NBINS_NATIVE);
 	} else {
-		cvZero(body);
-		cvZero(tmp);
+		depth_decimate_hist(depth, s->coarse, hist, d);
+		cumhist_build(&c, hist, NBINS);
+	}
+
+	if (!get_body_depth_interval(&c, native ? NATIVE_GAP : 1,
+				     s->min_area, interval)) {
+		clear_body(s);
+		return NULL;
+	}
+
+	coarse_bbox(s->coarse, interval[1], bb);
+	if (bb[2] < 0) {
+		clear_body(s);
+		return NULL;
 	}
-	
-	cvConvertScale(depth, tmp, 255./2048., 0);
-	hist = get_depth_histogram(tmp);
 
-	do {
-		get_body_depth_interval(hist, start, interval);
-		area = get_interval_area(hist, interval);
-		start = interval[1]+1;
+	x0 = (bb[0]-1)*d < 0 ? 0 : (bb[0]-1)*d;
+	y0 = (bb[1]-1)*d < 0 ? 0 : (bb[1]-1)*d;
+	x1 = (bb[2]+2)*d > depth->width ? depth->width : (bb[2]+2)*d;
+	y1 = (bb[3]+2)*d > depth->height ? depth->height : (bb[3]+2)*d;
+	r = cvRect(x0, y0, x1-x0, y1-y0);
+
+	if (s->mask_roi.width > 0 && s->mask_roi.height > 0) {
+		cvSetImageROI(s->body, s->mask_roi);
+		cvZero(s->body);
+		cvResetImageROI(s->body);
+	}
 
-	} while (area < 0.15);
+	bb[0] = depth->width;
+	bb[1] = depth->height;
+	bb[2] = bb[3] = -1;
+	if (native) {
+		get_body_image_native(depth, s->body, interval, r, bb);
+	} else {
+		get_body_image_quantize(depth, s->body, interval, r, bb);
+	}
 
-	get_body_image(tmp, body, interval);
+	s->mask_roi = r;
+	s->roi = bbox_rect(bb);
 
-	return body;
+	return s->body;
 }
 
 /*!
- * \brief Compute histogram of the depth image.
+ * \brief Bounding box of the non zero coarse pixels up to a depth.
  *
+ * \param[in]   coarse depth image (8 or 16 bit)
+ * \param[in]   maximum depth
+ * \param[out]  bounding box (min x, min y, max x, max y)
+ */
+static void coarse_bbox (IplImage *img, int max, int *bb)
+{
+	int i, j;
+
+	for (i=0; i<img->height; i++) {
+		int first=-1, last=-1;
+
+		for (j=0; j<img->width; j++) {
+			int v = img->depth == IPL_DEPTH_16U ?
+				((uint16_t*)(img->imageData + i*img->widthStep))[j] :
+				((uint8_t*)(img->imageData + i*img->widthStep))[j];
+
+			if (v && v <= max) {
+				if (first < 0)
+					first = j;
+				last = j;
+			}
+		}
+		if (first >= 0)
+			update_bbox(i, first, last, bb);
+	}
+}
+
+/*!
+ * \brief Detect every body in depth image.
+ *
+ * This uses the default (process wide) context, see
+ * body_detection_multi_ctx.
+ *
+ * \param[in]   depth image
+ * \param[out]  users (max elements)
+ * \param[in]   maximum number of users
+ * \return      number of users found
+ */
+int body_detection_multi (IplImage *depth, xkin_user *users, int max)
+{
+	return body_detection_multi_ctx(xkin_default_ctx(), depth, users, max);
+}
+
+/*!
+ * \brief Detect every body in depth image using a pipeline context.
+ *
+ * Each depth support whose area is at least ctx->body.min_area is a
+ * user, the users are ordered from the nearest. All of them are
+ * labelled in a single pass over the frame: ctx->body.labels holds the
+ * user label of every pixel (0 for background) and ctx->body.body the
+ * depth of every user. Unlike body_detection, pixels nearer than a
+ * user but not part of any user are removed.
+ *
+ * To run the hand, posture and gesture stages per user, extract the
+ * user with body_user_image_ctx and use one context per user for the
+ * following stages.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   depth image
+ * \param[out]  users (max elements)
+ * \param[in]   maximum number of users (at most XKIN_MAX_USERS)
+ * \return      number of users found (with none, the body and label
+ *              images are cleared and ctx->body.roi is empty)
+ */
+int body_detection_multi_ctx (xkin_ctx *ctx, IplImage *depth,
+			      xkin_user *users, int max)
+{
+	xkin_body *s = &(ctx->body);
+	unsigned int hist[NBINS_NATIVE];
+	depth_support sup[NBINS_NATIVE/2];
+	uint8_t lut[NBINS_NATIVE];
+	int i, n=0, num, native = (ctx->depth_mode == XKIN_DEPTH_NATIVE);
+	int nbins = native ? NBINS_NATIVE : NBINS;
+	cumhist c;
+
+	if (max > XKIN_MAX_USERS)
+		max = XKIN_MAX_USERS;
+
+	create_images(s, depth, native);
+	if (s->labels == NULL)
+		s->labels = cvCreateImage(cvGetSize(depth), 8, 1);
+
+	if (s->bg_warmup > 0)
+		depth = background_filter(s, depth);
+
+	body_histogram(ctx, depth, native, hist);
+	cumhist_build(&c, hist, nbins);
+	num = cumhist_supports(&c, native ? NATIVE_GAP : 1, sup, NBINS_NATIVE/2);
+
+	memset(lut, 0, sizeof(lut));
+	for (i=0; i<num && n<max; i++) {
+		if (sup[i].area < s->min_area)
+			continue;
+
+		users[n].label = n+1;
+		users[n].interval[0] = sup[i].min;
+		users[n].interval[1] = sup[i].max;
+		users[n].area = sup[i].area;
+		memset(lut + sup[i].min, n+1, sup[i].max - sup[i].min + 1);
+		n++;
+	}
+
+	if (n == 0) {
+		clear_body(s);
+		cvZero(s->labels);
+		return 0;
+	}
+
+	label_users(native ? depth : s->tmp, s->body, s->labels, lut, nbins,
+		    users, n);
+	s->mask_roi = cvRect(0, 0, depth->width, depth->height);
+
+	s->roi = users[0].roi;
+	for (i=1; i<n; i++) {
+		int bb[4] = {s->roi.x, s->roi.y, s->roi.x + s->roi.width - 1,
+			     s->roi.y + s->roi.height - 1};
+		CvRect r = users[i].roi;
+
+		update_bbox(r.y, r.x, r.x + r.width - 1, bb);
+		update_bbox(r.y + r.height - 1, r.x, r.x + r.width - 1, bb);
+		s->roi = bbox_rect(bb);
+	}
+
+	return n;
+}
+
+/*!
+ * \brief Depth image of a single user.
+ *
+ * The image is built from the last body_detection_multi_ctx output,
+ * only the user bounding box is scanned. The returned image is owned
+ * by the context and overwritten by the next call, pass it with
+ * user->roi to hand_detection_ctx.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   user
+ * \return      user depth image (same depth of the body image)
+ */
+IplImage *body_user_image_ctx (xkin_ctx *ctx, xkin_user *user)
+{
+	xkin_body *s = &(ctx->body);
+	CvRect r = user->roi;
+	int i, j;
+
+	if (s->user!=NULL && s->user->depth!=s->body->depth)
+		cvReleaseImage(&(s->user));
+
+	if (s->user==NULL) {
+		s->user = cvCreateImage(cvGetSize(s->body), s->body->depth, 1);
+		cvZero(s->user);
+	} else if (s->user_roi.width > 0 && s->user_roi.height > 0) {
+		cvSetImageROI(s->user, s->user_roi);
+		cvZero(s->user);
+		cvResetImageROI(s->user);
+	}
+
+	for (i=r.y; i<r.y+r.height; i++) {
+		uint8_t *lab = (uint8_t*)(s->labels->imageData +
+					  i*s->labels->widthStep);
+
+		if (s->body->depth == IPL_DEPTH_16U) {
+			uint16_t *src = (uint16_t*)(s->body->imageData +
+						    i*s->body->widthStep);
+			uint16_t *dst = (uint16_t*)(s->user->imageData +
+						    i*s->user->widthStep);
+
+			for (j=r.x; j<r.x+r.width; j++) {
+				dst[j] = lab[j] == user->label ? src[j] : 0;
+			}
+		} else {
+			uint8_t *src = (uint8_t*)(s->body->imageData +
+						  i*s->body->widthStep);
+			uint8_t *dst = (uint8_t*)(s->user->imageData +
+						  i*s->user->widthStep);
+
+			for (j=r.x; j<r.x+r.width; j++) {
+				dst[j] = lab[j] == user->label ? src[j] : 0;
+			}
+		}
+	}
+	s->user_roi = r;
+
+	return s->user;
+}
+
+/*!
+ * \brief Learn the background model again.
+ *
+ * The next ctx->body.bg_warmup frames are used to learn the scene.
+ *
+ * \param[in]  pipeline context
+ */
+void body_background_reset_ctx (xkin_ctx *ctx)
+{
+	ctx->body.bg_frames = 0;
+}
+
+/*!
+ * \brief Create (or recreate for a new depth mode) the body images.
+ *
+ * \param[in]  body state
  * \param[in]  depth image
- * \return     histogram
+ * \param[in]  native depth mode
  */
-static CvHistogram *get_depth_histogram (IplImage *img)
+static void create_images (xkin_body *s, IplImage *depth, int native)
 {
-	int hist_size[] = {NBINS};
-	float range[] = {0, 255};
-	float *ranges[] = {range};
-	CvHistogram *hist;
-	
-	hist = cvCreateHist(1, hist_size, CV_HIST_ARRAY, ranges, 1);
+	int type = native ? IPL_DEPTH_16U : IPL_DEPTH_8U;
 
-	cvCalcHist(&img, hist, 0, 0);
-	cvNormalizeHist(hist, 1.0);
+	if (s->body!=NULL && s->body->depth!=type) {
+		s->tracked = 0;
+		cvReleaseImage(&(s->body));
+		if (s->tmp!=NULL)
+			cvReleaseImage(&(s->tmp));
+	}
+	if (s->body==NULL) {
+		s->body = cvCreateImage(cvGetSize(depth), type, 1);
+		cvZero(s->body);
+		s->mask_roi = cvRect(0, 0, 0, 0);
+		if (!native)
+			s->tmp = cvCreateImage(cvGetSize(depth), 8, 1);
+	}
+}
 
-	return hist;
+/*!
+ * \brief Forget the last body, used when a frame has no body.
+ *
+ * The masked region of the body image is zeroed, the body boxes are
+ * emptied and the tracked interval is dropped, so neither the hand
+ * functions nor the next frame see a stale body.
+ *
+ * \param[in]  body state
+ */
+static void clear_body (xkin_body *s)
+{
+	if (s->mask_roi.width > 0 && s->mask_roi.height > 0) {
+		cvSetImageROI(s->body, s->mask_roi);
+		cvZero(s->body);
+		cvResetImageROI(s->body);
+	}
+	s->mask_roi = cvRect(0, 0, 0, 0);
+	s->roi = cvRect(0, 0, 0, 0);
+	s->interval[0] = s->interval[1] = 0;
+	s->tracked = 0;
+}
+
+/*!
+ * \brief Compute the depth histogram (and the 8 bit depth image).
+ *
+ * \param[in]   pipeline context
+ * \param[in]   depth image
+ * \param[in]   native depth mode
+ * \param[out]  histogram (NBINS or NBINS_NATIVE counts)
+ */
+static void body_histogram (xkin_ctx *ctx, IplImage *depth, int native,
+			    unsigned int *hist)
+{
+	xkin_body *s = &(ctx->body);
+	int i, j, nbins = native ? NBINS_NATIVE : NBINS;
+	body_tiles t;
+
+	if (ctx->pool == NULL) {
+		if (native)
+			depth_hist_native(depth, hist);
+		else
+			depth_quantize_hist(depth, s->tmp, hist);
+		return;
+	}
+
+	if (s->tiles == NULL)
+		s->tiles = (unsigned int*)malloc(sizeof(unsigned int) *
+						 XKIN_MAX_THREADS * NBINS_NATIVE);
+
+	depth_quantize_init();
+
+	t.depth = depth;
+	t.img = native ? NULL : s->tmp;
+	t.hist = s->tiles;
+	t.num = xkin_pool_size(ctx->pool);
+	xkin_pool_run(ctx->pool, tile_hist, &t, t.num);
+
+	for (j=0; j<nbins; j++) {
+		unsigned int sum = 0;
+
+		for (i=0; i<t.num; i++) {
+			sum += t.hist[i*NBINS_NATIVE + j];
+		}
+		hist[j] = sum;
+	}
+}
+
+/*!
+ * \brief Mask the depth image according the body interval.
+ *
+ * In 8 bit mode the masked image is the one quantized by
+ * body_histogram, unless quantize is set: then the depth rows are
+ * quantized by the masking pass itself (see get_body_image_quantize).
+ *
+ * \param[in]   pipeline context
+ * \param[in]   depth image
+ * \param[in]   native depth mode
+ * \param[in]   body depth interval
+ * \param[in]   quantize the depth image (8 bit mode only)
+ * \return      body bounding box
+ */
+static CvRect body_mask (xkin_ctx *ctx, IplImage *depth, int native,
+			 int *interval, int quantize)
+{
+	xkin_body *s = &(ctx->body);
+	int i, bb[4] = {depth->width, depth->height, -1, -1};
+	body_tiles t;
+
+	if (ctx->pool == NULL) {
+		CvRect r = cvRect(0, 0, depth->width, depth->height);
+
+		if (native)
+			get_body_image_native(depth, s->body, interval, r, bb);
+		else if (quantize)
+			get_body_image_quantize(depth, s->body, interval, r, bb);
+		else
+			get_body_image(s->tmp, s->body, interval, r, bb);
+		return bbox_rect(bb);
+	}
+
+	t.depth = depth;
+	t.img = native ? NULL : s->tmp;
+	t.body = s->body;
+	t.interval = interval;
+	t.quantize = quantize;
+	t.num = xkin_pool_size(ctx->pool);
+	xkin_pool_run(ctx->pool, tile_mask, &t, t.num);
+
+	for (i=0; i<t.num; i++) {
+		if (t.bb[i][2] < 0)
+			continue;
+		update_bbox(t.bb[i][1], t.bb[i][0], t.bb[i][2], bb);
+		update_bbox(t.bb[i][3], t.bb[i][0], t.bb[i][2], bb);
+	}
+
+	return bbox_rect(bb);
+}
+
+/*!
+ * \brief Histogram of one row tile (pool job).
+ */
+static void tile_hist (void *arg, int i)
+{
+	body_tiles *t = (body_tiles*)arg;
+	int start = t->depth->height * i / t->num;
+	int end = t->depth->height * (i+1) / t->num;
+	unsigned int *hist = t->hist + i*NBINS_NATIVE;
+
+	if (t->img == NULL)
+		depth_hist_native_rows(t->depth, hist, start, end);
+	else
+		depth_quantize_hist_rows(t->depth, t->img, hist, start, end);
+}
+
+/*!
+ * \brief Mask of one row tile (pool job).
+ */
+static void tile_mask (void *arg, int i)
+{
+	body_tiles *t = (body_tiles*)arg;
+	int start = t->depth->height * i / t->num;
+	int end = t->depth->height * (i+1) / t->num;
+	CvRect r = cvRect(0, start, t->depth->width, end-start);
+	int *bb = t->bb[i];
+
+	bb[0] = t->depth->width;
+	bb[1] = t->depth->height;
+	bb[2] = bb[3] = -1;
+
+	if (t->img == NULL)
+		get_body_image_native(t->depth, t->body, t->interval, r, bb);
+	else if (t->quantize)
+		get_body_image_quantize(t->depth, t->body, t->interval, r, bb);
+	else
+		get_body_image(t->img, t->body, t->interval, r, bb);
 }
 
 /*!
  * \brief Compute depth values interval defined by the body.
  *
  * Body depth interval is considered as the nearst (respect Kinect)
- * support of the depth historgram.
+ * support of the depth historgram which covers at least a given
+ * fraction of the image. 
  *
- * \param[in]  depth histrogram
- * \parma[in]  histogram bin starting point
+ * \param[in]  cumulative depth histrogram
+ * \param[in]  empty bins between two supports
+ * \param[in]  minimum body area
  * \param[out] interval array (2 elements: min and max depth values)
+ * \return     1 if the body is found, 0 otherwise
+ */
+static int get_body_depth_interval (cumhist *c, int gap, float min_area,
+				    int *interval)
+{
+	depth_support sup[NBINS_NATIVE/2];
+	int i, num;
+
+	num = cumhist_supports(c, gap, sup, NBINS_NATIVE/2);
+
+	for (i=0; i<num; i++) {
+		if (sup[i].area >= min_area) {
+			interval[0] = sup[i].min;
+			interval[1] = sup[i].max;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+/*!
+ * \brief Mask the depth image according the body interval.
+ *
+ * Body is isolatede in the depth image forcing to zero every pixels
+ * farther than the body interval. The bounding box of the body is
+ * computed in the same pass. Only the pixels inside r are processed.
+ *
+ * \param[in]      depth image
+ * \param[out]     body depth image
+ * \params[in]     body depth interval
+ * \param[in]      processed region
+ * \param[in,out]  body bounding box (min x, min y, max x, max y)
  */
-static void get_body_depth_interval (CvHistogram *hist, int start, int *interval)
+static void get_body_image (IplImage *img, IplImage *body, int *interval,
+			    CvRect r, int *bb)
 {
-	int i, asd=1;
-	float val;
+	int i, j, max = interval[1];
 
-	for (i=start; i<NBINS-1; i++) {
+	for (i=r.y; i<r.y+r.height; i++) {
+		uint8_t *src = (uint8_t*)(img->imageData + i*img->widthStep);
+		uint8_t *dst = (uint8_t*)(body->imageData + i*body->widthStep);
+		int first=-1, last=-1;
 
-		val = cvGetReal1D(hist->bins, i);
+		for (j=r.x; j<r.x+r.width; j++) {
+			dst[j] = src[j] <= max ? src[j] : 0;
+		}
+		for (j=r.x; j<r.x+r.width; j++) {
+			if (dst[j]) {
+				first = j;
+				break;
+			}
+		}
+		if (first < 0)
+			continue;
+		for (j=r.x+r.width-1; j>=first; j--) {
+			if (dst[j]) {
+				last = j;
+				break;
+			}
+		}
+		update_bbox(i, first, last, bb);
+	}
+}
 
-		if (asd) {
-			if (val !=0) {
-				interval[0] = i;
-				asd = 0;
+/*!
+ * \brief Mask the native depth image according the body interval.
+ *
+ * Same as get_body_image on the 16 bit image.
+ *
+ * \param[in]      depth image (16 bit)
+ * \param[out]     body depth image (16 bit)
+ * \params[in]     body depth interval
+ * \param[in]      processed region
+ * \param[in,out]  body bounding box (min x, min y, max x, max y)
+ */
+static void get_body_image_native (IplImage *img, IplImage *body,
+				   int *interval, CvRect r, int *bb)
+{
+	int i, j, max = interval[1];
+
+	for (i=r.y; i<r.y+r.height; i++) {
+		uint16_t *src = (uint16_t*)(img->imageData + i*img->widthStep);
+		uint16_t *dst = (uint16_t*)(body->imageData + i*body->widthStep);
+		int first=-1, last=-1;
+
+		for (j=r.x; j<r.x+r.width; j++) {
+			dst[j] = src[j] <= max ? src[j] : 0;
+		}
+		for (j=r.x; j<r.x+r.width; j++) {
+			if (dst[j]) {
+				first = j;
+				break;
 			}
-		} else {
-			if (val == 0) {
-				interval[1] = i-1;
+		}
+		if (first < 0)
+			continue;
+		for (j=r.x+r.width-1; j>=first; j--) {
+			if (dst[j]) {
+				last = j;
 				break;
 			}
 		}
+		update_bbox(i, first, last, bb);
 	}
 }
 
-static float get_interval_area (CvHistogram *hist, int *interval)
+/*!
+ * \brief Quantize and mask the depth image in a single pass.
+ *
+ * Each row is quantized directly into the body image and masked in
+ * place while it is still in cache, as get_body_image on the output
+ * of depth_quantize_rect. Used when no histogram pass has already
+ * produced the 8 bit image.
+ *
+ * \param[in]      depth image (16 bit)
+ * \param[out]     body depth image (8 bit)
+ * \params[in]     body depth interval
+ * \param[in]      processed region
+ * \param[in,out]  body bounding box (min x, min y, max x, max y)
+ */
+static void get_body_image_quantize (IplImage *depth, IplImage *body,
+				     int *interval, CvRect r, int *bb)
 {
-	float area = 0;
 	int i;
 
-	for (i=interval[0]; i<=interval[1]; i++) {
-		area += cvGetReal1D(hist->bins, i);
-	}
+	for (i=r.y; i<r.y+r.height; i++) {
+		CvRect row = cvRect(r.x, i, r.width, 1);
 
-	return area; 
+		depth_quantize_rect(depth, body, row);
+		get_body_image(body, body, interval, row, bb);
+	}
 }
 
-
 /*!
- * \brief Mask the depth image according the body interval.
+ * \brief Label the users and compute their bounding boxes.
  *
- * Body is isolatede in the depth image forcing to zero every pixels
- * which values is outside the body interval.
+ * Every pixel is labelled through a depth to label table, the body
+ * image keeps the depth of the labelled pixels.
  *
- * \param[in]    depth image
- * \param[out]   body depth image
- * \params[in]   body depth interval
+ * \param[in]   depth image (8 or 16 bit)
+ * \param[out]  body depth image
+ * \param[out]  label image
+ * \param[in]   depth to label table (nbins elements)
+ * \param[in]   number of table elements
+ * \param[out]  users (bounding boxes)
+ * \param[in]   number of users
  */
-static void get_body_image (IplImage *img, IplImage *body, int *interval)
+static void label_users (IplImage *img, IplImage *body, IplImage *labels,
+			 uint8_t *lut, int nbins, xkin_user *users, int num)
 {
-	cvThreshold(img, body, interval[0], 0, CV_THRESH_TOZERO);
-	cvThreshold(img, body, interval[1], 0, CV_THRESH_TOZERO_INV);
+	int bb[XKIN_MAX_USERS+1][4], first[XKIN_MAX_USERS+1], last[XKIN_MAX_USERS+1];
+	int i, j, k;
+
+	for (k=0; k<=num; k++) {
+		bb[k][0] = img->width;
+		bb[k][1] = img->height;
+		bb[k][2] = bb[k][3] = -1;
+	}
+
+	for (i=0; i<img->height; i++) {
+		uint8_t *lab = (uint8_t*)(labels->imageData + i*labels->widthStep);
+
+		for (k=0; k<=num; k++) {
+			first[k] = -1;
+		}
+
+		if (img->depth == IPL_DEPTH_16U) {
+			uint16_t *src = (uint16_t*)(img->imageData + i*img->widthStep);
+			uint16_t *dst = (uint16_t*)(body->imageData + i*body->widthStep);
+
+			for (j=0; j<img->width; j++) {
+				int l = src[j] < nbins ? lut[src[j]] : 0;
+
+				lab[j] = l;
+				dst[j] = l ? src[j] : 0;
+				if (first[l] < 0)
+					first[l] = j;
+				last[l] = j;
+			}
+		} else {
+			uint8_t *src = (uint8_t*)(img->imageData + i*img->widthStep);
+			uint8_t *dst = (uint8_t*)(body->imageData + i*body->widthStep);
+
+			for (j=0; j<img->width; j++) {
+				int l = lut[src[j]];
+
+				lab[j] = l;
+				dst[j] = l ? src[j] : 0;
+				if (first[l] < 0)
+					first[l] = j;
+				last[l] = j;
+			}
+		}
+
+		for (k=1; k<=num; k++) {
+			if (first[k] >= 0)
+				update_bbox(i, first[k], last[k], bb[k]);
+		}
+	}
+
+	for (k=1; k<=num; k++) {
+		users[k-1].roi = bbox_rect(bb[k]);
+	}
 }
 
+/*!
+ * \brief Extend a bounding box with the non zero span of a row.
+ *
+ * \param[in]      row index
+ * \param[in]      first non zero column
+ * \param[in]      last non zero column
+ * \param[in,out]  bounding box (min x, min y, max x, max y)
+ */
+static void update_bbox (int row, int first, int last, int *bb)
+{
+	if (first < bb[0]) bb[0] = first;
+	if (last > bb[2]) bb[2] = last;
+	if (row < bb[1]) bb[1] = row;
+	if (row > bb[3]) bb[3] = row;
+}
 
+/*!
+ * \brief Convert a bounding box to a rectangle.
+ *
+ * \param[in]  bounding box (min x, min y, max x, max y)
+ * \return     rectangle, empty if the box is empty
+ */
+static CvRect bbox_rect (int *bb)
+{
+	if (bb[2] < 0)
+		return cvRect(0, 0, 0, 0);
 
+	return cvRect(bb[0], bb[1], bb[2]-bb[0]+1, bb[3]-bb[1]+1);
+}
@@ -3,6 +3,11 @@
 
 
 IplImage*            body_detection           (IplImage*);
+IplImage*            body_detection_ctx       (xkin_ctx*, IplImage*);
+int                  body_detection_multi     (IplImage*, xkin_user*, int);
+int                  body_detection_multi_ctx (xkin_ctx*, IplImage*, xkin_user*, int);
+IplImage*            body_user_image_ctx      (xkin_ctx*, xkin_user*);
+void                 body_background_reset_ctx(xkin_ctx*);
 	
 
 #endif /* _BODY_H_ */
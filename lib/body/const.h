@@ -3,8 +3,16 @@
 
 enum {
 	NBINS=256,
+	NBINS_NATIVE=2048,
+	NATIVE_GAP=8,
+	TRACK_STEP=8,
+	TRACK_GUARD=2,
+	TRACK_GUARD_NATIVE=16,
+	BG_TOL=8,
 	W=256,
 	H=256
 };
 
+#define TRACK_GUARD_AREA        0.005
+
 #endif /* _CONST_H_ */
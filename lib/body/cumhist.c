@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file cumhist.c
+ * \author Fabrizio Pedersoli
+ *
+ * Cumulative depth histogram. Once built, the area of any depth
+ * interval is a single difference, and all the supports (runs of non
+ * empty bins) of the histogram are found with one sweep.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "const.h"
+#include "cumhist.h"
+
+
+/*!
+ * \brief Build the cumulative histogram.
+ *
+ * cum[i] is the number of pixels in the bins [0,i), so cum[nbins] is
+ * the total number of pixels.
+ *
+ * \param[out]  cumulative histogram
+ * \param[in]   depth histogram 
+ * \param[in]   number of bins (at most NBINS_NATIVE)
+ */
+void cumhist_build (cumhist *c, unsigned int *hist, int nbins)
+{
+	int i;
+
+	c->nbins = nbins;
+	c->cum[0] = 0;
+	for (i=0; i<nbins; i++) {
+		c->cum[i+1] = c->cum[i] + hist[i];
+	}
+	c->total = c->cum[nbins];
+}
+
+/*!
+ * \brief Fraction of pixels within a depth interval.
+ *
+ * \param[in]  cumulative histogram
+ * \param[in]  first bin
+ * \param[in]  last bin (included)
+ * \return     normalized area
+ */
+float cumhist_area (cumhist *c, int min, int max)
+{
+	if (c->total == 0 || max < min)
+		return 0;
+
+	return (float)(c->cum[max+1] - c->cum[min]) / c->total;
+}
+
+/*!
+ * \brief Find the supports of the histogram.
+ *
+ * A support is a maximal interval of non empty bins, two supports are
+ * separated by at least gap empty bins. Bin 0 (no depth reading) and
+ * the last bin are never part of a support. Supports are returned
+ * from the nearest to the farthest.
+ *
+ * \param[in]   cumulative histogram
+ * \param[in]   minimum number of empty bins between supports
+ * \param[out]  array of supports
+ * \param[in]   size of the array
+ * \return      number of supports found
+ */
+int cumhist_supports (cumhist *c, int gap, depth_support *sup, int num)
+{
+	int i, n=0, min=-1, last=0;
+
+	for (i=1; i<c->nbins-1 && n<num; i++) {
+		int full = c->cum[i+1] != c->cum[i];
+
+		if (full) {
+			if (min < 0)
+				min = i;
+			last = i;
+		} else if (min >= 0 && i-last >= gap) {
+			sup[n].min = min;
+			sup[n].max = last;
+			sup[n].area = cumhist_area(c, min, last);
+			n++;
+			min = -1;
+		}
+	}
+
+	if (min >= 0 && n < num) {
+		sup[n].min = min;
+		sup[n].max = last;
+		sup[n].area = cumhist_area(c, min, last);
+		n++;
+	}
+
+	return n;
+}
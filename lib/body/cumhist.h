@@ -0,0 +1,26 @@
+#ifndef _CUMHIST_H_
+#define _CUMHIST_H_
+
+/*!
+ * \brief Cumulative depth histogram.
+ */
+typedef struct cumhist {
+	unsigned int cum[NBINS_NATIVE+1]; //!< cum[i] = pixels in bins [0,i)
+	unsigned int total;               //!< number of pixels
+	int nbins;                        //!< number of bins
+} cumhist;
+
+/*!
+ * \brief Histogram support (depth interval of non empty bins).
+ */
+typedef struct depth_support {
+	int min;                     //!< first bin
+	int max;                     //!< last bin
+	float area;                  //!< normalized area
+} depth_support;
+
+void       cumhist_build        (cumhist*, unsigned int*, int);
+float      cumhist_area         (cumhist*, int, int);
+int        cumhist_supports     (cumhist*, int, depth_support*, int);
+
+#endif /* _CUMHIST_H_ */
@@ -0,0 +1,522 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file quantize.c
+ * \author Fabrizio Pedersoli
+ *
+ * Fused depth quantization and histogram kernel. The raw 11 bit
+ * kinect depth is read once, each row is converted to 8 bit (SSE2 or
+ * AVX2, selected at run time) and its histogram is accumulated while
+ * the row is still in cache. For the native depth mode the histogram
+ * is computed directly on the 11 bit values. The decimated variants
+ * sample the depth image while converting it, for the coarse body
+ * search.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <opencv2/core/core_c.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#include "const.h"
+#include "quantize.h"
+
+
+typedef void (*quantize_row_fn) (const uint16_t*, uint8_t*, int);
+
+static void               select_quantize_row    (void);
+static uint8_t            quantize_value         (uint16_t);
+static void               quantize_row_c         (const uint16_t*, uint8_t*, int);
+static void               count_row              (const uint8_t*, int, uint32_t (*)[NBINS]);
+
+#if HAVE_X86_DISPATCH && defined(__SSE2__)
+static void               quantize_row_sse2      (const uint16_t*, uint8_t*, int);
+#endif
+#if HAVE_X86_DISPATCH
+static void               quantize_row_avx2      (const uint16_t*, uint8_t*, int);
+#endif
+
+
+static quantize_row_fn quantize_row = NULL;
+static pthread_once_t quantize_once = PTHREAD_ONCE_INIT;
+
+
+/*!
+ * \brief Select the row kernel.
+ *
+ * It is called by every quantization, the kernel is selected once
+ * whatever the thread.
+ */
+void depth_quantize_init (void)
+{
+	pthread_once(&quantize_once, select_quantize_row);
+}
+
+/*!
+ * \brief Convert the depth image to 8 bit and compute its histogram.
+ *
+ * The result is the same of cvConvertScale(depth, dst, 255./2048.)
+ * followed by cvCalcHist with NBINS bins over [0,255): depth values
+ * are rounded to nearest (ties to even) and pixels equal to 255 are
+ * not counted.
+ *
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[out]  8 bit depth image
+ * \param[out]  histogram (NBINS counts)
+ * \return      number of pixels counted in the histogram
+ */
+unsigned int depth_quantize_hist (IplImage *depth, IplImage *dst,
+				  unsigned int *hist)
+{
+	return depth_quantize_hist_rows(depth, dst, hist, 0, depth->height);
+}
+
+/*!
+ * \brief Same as depth_quantize_hist on the rows [start,end).
+ *
+ * Only the given rows of dst are written and the image headers are
+ * not modified, so different threads can work on disjoint rows of
+ * the same images.
+ *
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[out]  8 bit depth image
+ * \param[out]  histogram of the rows (NBINS counts)
+ * \param[in]   first row
+ * \param[in]   last row (excluded)
+ * \return      number of pixels counted in the histogram
+ */
+unsigned int depth_quantize_hist_rows (IplImage *depth, IplImage *dst,
+				       unsigned int *hist, int start, int end)
+{
+	uint32_t sub[4][NBINS];
+	unsigned int total=0;
+	int i, j;
+
+	depth_quantize_init();
+
+	memset(sub, 0, sizeof(sub));
+
+	if (depth->depth == IPL_DEPTH_16U && depth->nChannels == 1) {
+		for (i=start; i<end; i++) {
+			uint16_t *src = (uint16_t*)(depth->imageData +
+						    i*depth->widthStep);
+			uint8_t *row = (uint8_t*)(dst->imageData +
+						  i*dst->widthStep);
+
+			quantize_row(src, row, depth->width);
+			count_row(row, depth->width, sub);
+		}
+	} else if (end > start) {
+		CvMat a, b;
+		CvRect r = cvRect(0, start, depth->width, end-start);
+
+		cvGetSubRect(depth, &a, r);
+		cvGetSubRect(dst, &b, r);
+		cvConvertScale(&a, &b, 255./2048., 0);
+
+		for (i=start; i<end; i++) {
+			uint8_t *row = (uint8_t*)(dst->imageData +
+						  i*dst->widthStep);
+
+			count_row(row, dst->width, sub);
+		}
+	}
+
+	for (j=0; j<NBINS; j++) {
+		hist[j] = (j == NBINS-1) ? 0 :
+			sub[0][j] + sub[1][j] + sub[2][j] + sub[3][j];
+		total += hist[j];
+	}
+
+	return total;
+}
+
+/*!
+ * \brief Compute the histogram of the native 11 bit depth image.
+ *
+ * Values above NBINS_NATIVE-1 are counted in the last bin, which is
+ * the kinect "no reading" value and is excluded from the total.
+ *
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[out]  histogram (NBINS_NATIVE counts)
+ * \return      number of pixels counted in the histogram
+ */
+unsigned int depth_hist_native (IplImage *depth, unsigned int *hist)
+{
+	return depth_hist_native_rows(depth, hist, 0, depth->height);
+}
+
+/*!
+ * \brief Same as depth_hist_native on the rows [start,end).
+ *
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[out]  histogram of the rows (NBINS_NATIVE counts)
+ * \param[in]   first row
+ * \param[in]   last row (excluded)
+ * \return      number of pixels counted in the histogram
+ */
+unsigned int depth_hist_native_rows (IplImage *depth, unsigned int *hist,
+				     int start, int end)
+{
+	uint32_t sub[2][NBINS_NATIVE];
+	unsigned int total=0;
+	int i, j;
+
+	memset(sub, 0, sizeof(sub));
+
+	for (i=start; i<end; i++) {
+		uint16_t *src = (uint16_t*)(depth->imageData + i*depth->widthStep);
+
+		for (j=0; j+2<=depth->width; j+=2) {
+			uint16_t a = src[j], b = src[j+1];
+
+			sub[0][a < NBINS_NATIVE ? a : NBINS_NATIVE-1]++;
+			sub[1][b < NBINS_NATIVE ? b : NBINS_NATIVE-1]++;
+		}
+		for (; j<depth->width; j++) {
+			uint16_t a = src[j];
+
+			sub[0][a < NBINS_NATIVE ? a : NBINS_NATIVE-1]++;
+		}
+	}
+
+	for (j=0; j<NBINS_NATIVE; j++) {
+		hist[j] = (j == NBINS_NATIVE-1) ? 0 : sub[0][j] + sub[1][j];
+		total += hist[j];
+	}
+
+	return total;
+}
+
+/*!
+ * \brief Decimate and quantize the depth image and compute its histogram.
+ *
+ * The coarse image pixel (i,j) is the quantized depth of pixel
+ * (i*step,j*step), the histogram is the same of depth_quantize_hist
+ * on the coarse image.
+ *
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[out]  coarse 8 bit image (size rounded up)
+ * \param[out]  histogram (NBINS counts)
+ * \param[in]   decimation step
+ * \return      number of pixels counted in the histogram
+ */
+unsigned int depth_decimate_hist (IplImage *depth, IplImage *coarse,
+				  unsigned int *hist, int step)
+{
+	uint32_t sub[4][NBINS];
+	unsigned int total=0;
+	int i, j;
+
+	memset(sub, 0, sizeof(sub));
+
+	for (i=0; i<coarse->height; i++) {
+		uint16_t *src = (uint16_t*)(depth->imageData +
+					    i*step*depth->widthStep);
+		uint8_t *row = (uint8_t*)(coarse->imageData + i*coarse->widthStep);
+
+		for (j=0; j<coarse->width; j++) {
+			row[j] = quantize_value(src[j*step]);
+		}
+		count_row(row, coarse->width, sub);
+	}
+
+	for (j=0; j<NBINS; j++) {
+		hist[j] = (j == NBINS-1) ? 0 :
+			sub[0][j] + sub[1][j] + sub[2][j] + sub[3][j];
+		total += hist[j];
+	}
+
+	return total;
+}
+
+/*!
+ * \brief Decimate the native depth image and compute its histogram.
+ *
+ * Same as depth_decimate_hist without quantization, the histogram is
+ * the one of depth_hist_native.
+ *
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[out]  coarse 16 bit image (size rounded up)
+ * \param[out]  histogram (NBINS_NATIVE counts)
+ * \param[in]   decimation step
+ * \return      number of pixels counted in the histogram
+ */
+unsigned int depth_decimate_hist_native (IplImage *depth, IplImage *coarse,
+					 unsigned int *hist, int step)
+{
+	uint32_t sub[NBINS_NATIVE];
+	unsigned int total=0;
+	int i, j;
+
+	memset(sub, 0, sizeof(sub));
+
+	for (i=0; i<coarse->height; i++) {
+		uint16_t *src = (uint16_t*)(depth->imageData +
+					    i*step*depth->widthStep);
+		uint16_t *row = (uint16_t*)(coarse->imageData +
+					    i*coarse->widthStep);
+
+		for (j=0; j<coarse->width; j++) {
+			uint16_t a = src[j*step];
+
+			row[j] = a;
+			sub[a < NBINS_NATIVE ? a : NBINS_NATIVE-1]++;
+		}
+	}
+
+	for (j=0; j<NBINS_NATIVE; j++) {
+		hist[j] = (j == NBINS_NATIVE-1) ? 0 : sub[j];
+		total += hist[j];
+	}
+
+	return total;
+}
+
+/*!
+ * \brief Histogram of a sparse sample of the depth image.
+ *
+ * One pixel every step rows and columns is counted, quantized as in
+ * depth_quantize_hist or native as in depth_hist_native. The last bin
+ * is excluded.
+ *
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[out]  histogram (NBINS or NBINS_NATIVE counts)
+ * \param[in]   sampling step
+ * \param[in]   native depth values
+ * \return      number of pixels counted in the histogram
+ */
+unsigned int depth_sample_hist (IplImage *depth, unsigned int *hist,
+				int step, int native)
+{
+	int i, j, nbins = native ? NBINS_NATIVE : NBINS;
+	unsigned int total=0;
+
+	memset(hist, 0, sizeof(unsigned int) * nbins);
+
+	for (i=step/2; i<depth->height; i+=step) {
+		uint16_t *src = (uint16_t*)(depth->imageData + i*depth->widthStep);
+
+		for (j=step/2; j<depth->width; j+=step) {
+			int v = native ? src[j] : quantize_value(src[j]);
+
+			hist[v < nbins ? v : nbins-1]++;
+		}
+	}
+
+	hist[nbins-1] = 0;
+	for (j=0; j<nbins; j++) {
+		total += hist[j];
+	}
+
+	return total;
+}
+
+/*!
+ * \brief Quantize a region of the depth image.
+ *
+ * \param[in]   depth image (16 bit, 1 channel)
+ * \param[out]  8 bit depth image (only the region is written)
+ * \param[in]   region
+ */
+void depth_quantize_rect (IplImage *depth, IplImage *dst, CvRect r)
+{
+	int i;
+
+	depth_quantize_init();
+
+	for (i=r.y; i<r.y+r.height; i++) {
+		uint16_t *src = (uint16_t*)(depth->imageData + i*depth->widthStep);
+		uint8_t *row = (uint8_t*)(dst->imageData + i*dst->widthStep);
+
+		quantize_row(src + r.x, row + r.x, r.width);
+	}
+}
+
+/*!
+ * \brief Choose the fastest row kernel supported by the cpu.
+ *
+ * \return  row quantization function
+ */
+static void select_quantize_row (void)
+{
+	quantize_row = quantize_row_c;
+#if HAVE_X86_DISPATCH
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2")) {
+		quantize_row = quantize_row_avx2;
+		return;
+	}
+#if defined(__SSE2__)
+	if (__builtin_cpu_supports("sse2"))
+		quantize_row = quantize_row_sse2;
+#endif
+#endif
+}
+
+/*!
+ * \brief Quantize a single depth value.
+ *
+ * q = round(v*255/2048), ties to even as cvRound does. The product
+ * is exact so everything is done in integer arithmetic.
+ *
+ * \param[in]  depth value
+ * \return     8 bit depth value
+ */
+static uint8_t quantize_value (uint16_t v)
+{
+	uint32_t r = (uint32_t)v * 255;
+	uint32_t q = (r + 1023 + ((r >> 11) & 1)) >> 11;
+
+	return q > 255 ? 255 : (uint8_t)q;
+}
+
+static void quantize_row_c (const uint16_t *src, uint8_t *dst, int n)
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		dst[i] = quantize_value(src[i]);
+	}
+}
+
+/*!
+ * \brief Accumulate the histogram of a 8 bit row.
+ *
+ * Four sub-histograms are used so that consecutive equal values (very
+ * common in depth images) don't stall on the same counter.
+ *
+ * \param[in]      8 bit row
+ * \param[in]      row length
+ * \param[in,out]  sub-histograms
+ */
+static void count_row (const uint8_t *row, int n, uint32_t (*sub)[NBINS])
+{
+	int i;
+
+	for (i=0; i+4<=n; i+=4) {
+		sub[0][row[i]]++;
+		sub[1][row[i+1]]++;
+		sub[2][row[i+2]]++;
+		sub[3][row[i+3]]++;
+	}
+	for (; i<n; i++) {
+		sub[0][row[i]]++;
+	}
+}
+
+#if HAVE_X86_DISPATCH && defined(__SSE2__)
+/*!
+ * \brief SSE2 version of quantize_value on 8 pixels.
+ *
+ * The 32 bit product v*255 is split in its 16 bit halves, the
+ * quotient and the remainder of the division by 2048 are then
+ * recovered with shifts.
+ */
+static __m128i quantize8_sse2 (__m128i v)
+{
+	const __m128i k255 = _mm_set1_epi16(255);
+	const __m128i mask = _mm_set1_epi16(2047);
+	const __m128i half = _mm_set1_epi16(1024);
+	const __m128i one = _mm_set1_epi16(1);
+	__m128i lo, hi, q, rem, up;
+
+	lo = _mm_mullo_epi16(v, k255);
+	hi = _mm_mulhi_epu16(v, k255);
+	q = _mm_or_si128(_mm_slli_epi16(hi, 5), _mm_srli_epi16(lo, 11));
+	rem = _mm_add_epi16(_mm_and_si128(lo, mask), _mm_and_si128(q, one));
+	up = _mm_cmpgt_epi16(rem, half);
+
+	return _mm_sub_epi16(q, up);
+}
+
+static void quantize_row_sse2 (const uint16_t *src, uint8_t *dst, int n)
+{
+	int i;
+
+	for (i=0; i+16<=n; i+=16) {
+		__m128i a, b;
+
+		a = quantize8_sse2(_mm_loadu_si128((const __m128i*)(src+i)));
+		b = quantize8_sse2(_mm_loadu_si128((const __m128i*)(src+i+8)));
+		_mm_storeu_si128((__m128i*)(dst+i), _mm_packus_epi16(a, b));
+	}
+	quantize_row_c(src+i, dst+i, n-i);
+}
+#endif
+
+#if HAVE_X86_DISPATCH
+__attribute__((target("avx2")))
+static __m256i quantize16_avx2 (__m256i v)
+{
+	const __m256i k255 = _mm256_set1_epi16(255);
+	const __m256i mask = _mm256_set1_epi16(2047);
+	const __m256i half = _mm256_set1_epi16(1024);
+	const __m256i one = _mm256_set1_epi16(1);
+	__m256i lo, hi, q, rem, up;
+
+	lo = _mm256_mullo_epi16(v, k255);
+	hi = _mm256_mulhi_epu16(v, k255);
+	q = _mm256_or_si256(_mm256_slli_epi16(hi, 5), _mm256_srli_epi16(lo, 11));
+	rem = _mm256_add_epi16(_mm256_and_si256(lo, mask),
+			       _mm256_and_si256(q, one));
+	up = _mm256_cmpgt_epi16(rem, half);
+
+	return _mm256_sub_epi16(q, up);
+}
+
+__attribute__((target("avx2")))
+static void quantize_row_avx2 (const uint16_t *src, uint8_t *dst, int n)
+{
+	int i;
+
+	for (i=0; i+32<=n; i+=32) {
+		__m256i a, b, p;
+
+		a = quantize16_avx2(_mm256_loadu_si256((const __m256i*)(src+i)));
+		b = quantize16_avx2(_mm256_loadu_si256((const __m256i*)(src+i+16)));
+		p = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+		_mm256_storeu_si256((__m256i*)(dst+i), p);
+	}
+	quantize_row_c(src+i, dst+i, n-i);
+}
+#endif
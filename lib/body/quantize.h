@@ -0,0 +1,14 @@
+#ifndef _QUANTIZE_H_
+#define _QUANTIZE_H_
+
+void             depth_quantize_init     (void);
+unsigned int     depth_quantize_hist     (IplImage*, IplImage*, unsigned int*);
+unsigned int     depth_quantize_hist_rows(IplImage*, IplImage*, unsigned int*, int, int);
+unsigned int     depth_hist_native       (IplImage*, unsigned int*);
+unsigned int     depth_hist_native_rows  (IplImage*, unsigned int*, int, int);
+unsigned int     depth_decimate_hist     (IplImage*, IplImage*, unsigned int*, int);
+unsigned int     depth_decimate_hist_native(IplImage*, IplImage*, unsigned int*, int);
+unsigned int     depth_sample_hist       (IplImage*, unsigned int*, int, int);
+void             depth_quantize_rect     (IplImage*, IplImage*, CvRect);
+
+#endif /* _QUANTIZE_H_ */
@@ -10,9 +10,9 @@ enum {
 	XVAR=10,
 	YVAR=10,
 	CLOSE=1,
+	STOP=0,
 	START=1,
-	COLLECT=2,
-	STOP=3
+	COLLECT=2
 };
 
 
@@ -41,6 +41,7 @@
 #include <stdlib.h>
 #include <opencv2/core/core_c.h>
 
+#include "libxkin.h"
 #include "const.h"
 #include "myalgos.h"
 #include "ptseq.h"
@@ -139,36 +140,52 @@ static double point_dist (CvPoint p1, CvPoint p2)
  */
 int cvhmm_get_gesture_sequence (int posture, CvPoint pt, ptseq *seq)
 {
-	static int state = STOP;
-	static int count = 0;
-	static int miss = 0;
-	static int tot = 0;
-	static CvPoint prev;
+	return cvhmm_get_gesture_sequence_ctx(xkin_default_ctx(), posture, pt,
+					      seq);
+}
+
+/*!
+ * \brief Get the correct gesture sequence from video stream using a
+ * pipeline context.
+ *
+ * The state machine is kept in the context, so each stream has its
+ * own. A new context starts in STOP state.
+ *
+ * \param[in]        pipeline context
+ * \param[in]        posture classification index
+ * \param[in]        hand centroid
+ * \param[in,out]    sequence of point
+ * \return           flag correct sequence ready
+ */
+int cvhmm_get_gesture_sequence_ctx (xkin_ctx *ctx, int posture, CvPoint pt,
+				    ptseq *seq)
+{
+	xkin_gesture *s = &(ctx->gesture);
 
-	switch (state) {
+	switch (s->state) {
 	case START:
 		if (posture == CLOSE) {
-			if (++count >= 5) {
-				state = COLLECT;
-				count = 0;
-				prev = cvPoint(pt.x, pt.y);
+			if (++s->count >= 5) {
+				s->state = COLLECT;
+				s->count = 0;
+				s->prev = cvPoint(pt.x, pt.y);
 			}
 		}
 		break;
 	case COLLECT:
 		if (posture == CLOSE) {
-			double dist = point_dist(pt, prev);
+			double dist = point_dist(pt, s->prev);
 
 			if (dist <= 100 && dist >= 3) {
 				ptseq_add(*seq, pt);
-				prev = cvPoint(pt.x, pt.y);
-				tot++;
+				s->prev = cvPoint(pt.x, pt.y);
+				s->tot++;
 			}
-			miss = 0;
+			s->miss = 0;
 		} else {
-			if (++miss >= 3) {
-				state = STOP;
-				if (tot >= 10) {
+			if (++s->miss >= 3) {
+				s->state = STOP;
+				if (s->tot >= 10) {
 					ptseq_remove_tail(*seq, 5);
 					return 1;
 				} else {
@@ -179,12 +196,12 @@ int cvhmm_get_gesture_sequence (int posture, CvPoint pt, ptseq *seq)
 		break;
 	case STOP:
 		if (posture == CLOSE) {
-			state = START;
+			s->state = START;
 			*seq = ptseq_reset(*seq);
-			tot = 0;
-			miss = 0;
+			s->tot = 0;
+			s->miss = 0;
 		}
-		count = 0;
+		s->count = 0;
 		break;
 	}
 	return 0;
@@ -2,6 +2,7 @@
 #define _MYHMM_H_
 
 #include <opencv2/core/core_c.h>
+#include "libxkin.h"
 #include "ptseq.h"
 
 typedef struct CvHMM {
@@ -19,5 +20,8 @@ CvHMM     cvhmm_blr_init               (int N, int M, double pii, double pij);
 void      cvhmm_free                   (CvHMM mo);
 void      cvhmm_print                  (CvHMM mo);
 int       cvhmm_classify_gesture       (CvHMM *mo, int num, ptseq seq, FILE* pf);
+int       cvhmm_get_gesture_sequence   (int posture, CvPoint pt, ptseq *seq);
+int       cvhmm_get_gesture_sequence_ctx (xkin_ctx *ctx, int posture,
+					  CvPoint pt, ptseq *seq);
 
 #endif /* _MYHMM_H_ */
@@ -0,0 +1,478 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file bitmask.c
+ * \author Fabrizio Pedersoli
+ *
+ * Bit packed binary masks (64 pixels per word) and binary morphology
+ * done with word wide boolean operations. The hand smoothing (3x3
+ * median, open, close) is done as a pipeline of row stages, so the
+ * mask is read and written once.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+#include "const.h"
+#include "bitmask.h"
+
+
+enum {
+	NSTAGES=5,       //!< median, erode, dilate (open), dilate, erode (close)
+	RING=3           //!< rows kept by each stage
+};
+
+typedef void (*row_op) (const uint64_t*, const uint64_t*, const uint64_t*,
+			uint64_t*, int, int);
+
+/*!
+ * \brief Row stage of the smoothing pipeline.
+ */
+typedef struct stage {
+	row_op op;
+	const uint64_t *prev;    //!< row above the current one (NULL at the top)
+	const uint64_t *cur;     //!< current row (NULL before the first)
+	uint64_t *out[RING];     //!< output rows
+	int slot;                //!< next output row
+} stage;
+
+/*!
+ * \brief Smoothing pipeline.
+ */
+typedef struct pipeline {
+	stage st[NSTAGES];
+	xkin_bitmask *m;         //!< mask (input and output)
+	int y;                   //!< next output row
+} pipeline;
+
+
+static void        median_row     (const uint64_t*, const uint64_t*, const uint64_t*, uint64_t*, int, int);
+static void        erode_row      (const uint64_t*, const uint64_t*, const uint64_t*, uint64_t*, int, int);
+static void        dilate_row     (const uint64_t*, const uint64_t*, const uint64_t*, uint64_t*, int, int);
+static void        stage_push     (pipeline*, int, const uint64_t*);
+static void        row_moments    (const uint64_t*, int, int, int,
+				   xkin_moments*, int*);
+
+
+/*!
+ * \brief Make room for a mask.
+ *
+ * \param[in]      pipeline context (allocation counter)
+ * \param[in,out]  mask
+ * \param[in]      width in pixels
+ * \param[in]      height in pixels
+ */
+void bitmask_reserve (xkin_ctx *ctx, xkin_bitmask *m, int width, int height)
+{
+	int stride = (width + 63) / 64;
+	size_t words = (size_t)stride * height;
+
+	if (words > m->capacity) {
+		free(m->bits);
+		m->bits = (uint64_t*)malloc(sizeof(uint64_t) * words);
+		m->capacity = words;
+		ctx->allocs++;
+	}
+	if (stride > m->scratch_stride) {
+		free(m->scratch);
+		m->scratch = (uint64_t*)malloc(sizeof(uint64_t) * stride *
+					       NSTAGES * RING);
+		m->scratch_stride = stride;
+		ctx->allocs++;
+	}
+
+	m->width = width;
+	m->height = height;
+	m->stride = stride;
+}
+
+/*!
+ * \brief Build the mask of the depth band (0,max] within a region.
+ *
+ * The raw moments of the mask are accumulated row by row as the rows
+ * are built, in image coordinates.
+ *
+ * \param[in]   pipeline context
+ * \param[out]  mask (region size)
+ * \param[in]   depth image (8 or 16 bit)
+ * \param[in]   region
+ * \param[in]   maximum depth
+ * \param[out]  moments of the mask
+ */
+void bitmask_from_depth (xkin_ctx *ctx, xkin_bitmask *m, IplImage *img,
+			 CvRect roi, int max, xkin_moments *mo)
+{
+	int i, j, bb[4] = {INT_MAX, INT_MAX, -1, -1};
+
+	mo->m00 = mo->m10 = mo->m01 = 0;
+
+	bitmask_reserve(ctx, m, roi.width, roi.height);
+	memset(m->bits, 0, sizeof(uint64_t) * m->stride * m->height);
+
+	for (i=0; i<roi.height; i++) {
+		char *row = img->imageData + (roi.y+i)*img->widthStep;
+		uint64_t *dst = m->bits + i*m->stride;
+
+		if (img->depth == IPL_DEPTH_16U) {
+			uint16_t *src = (uint16_t*)row + roi.x;
+
+			for (j=0; j<roi.width; j++) {
+				uint64_t b = (src[j]-1u) < (unsigned)max;
+
+				dst[j>>6] |= b << (j&63);
+			}
+		} else {
+			uint8_t *src = (uint8_t*)row + roi.x;
+
+			for (j=0; j<roi.width; j++) {
+				uint64_t b = (src[j]-1u) < (unsigned)max;
+
+				dst[j>>6] |= b << (j&63);
+			}
+		}
+
+		row_moments(dst, m->stride, roi.x, roi.y+i, mo, bb);
+	}
+
+	mo->bbox = bb[2] < 0 ? cvRect(0, 0, 0, 0) :
+		cvRect(bb[0], bb[1], bb[2]-bb[0]+1, bb[3]-bb[1]+1);
+}
+
+/*!
+ * \brief Build the mask of the non zero pixels within a region.
+ *
+ * \param[in]   pipeline context
+ * \param[out]  mask (region size)
+ * \param[in]   binary image
+ * \param[in]   region
+ */
+void bitmask_from_image (xkin_ctx *ctx, xkin_bitmask *m, IplImage *img,
+			 CvRect roi)
+{
+	int i, j;
+
+	bitmask_reserve(ctx, m, roi.width, roi.height);
+	memset(m->bits, 0, sizeof(uint64_t) * m->stride * m->height);
+
+	for (i=0; i<roi.height; i++) {
+		uint8_t *src = (uint8_t*)(img->imageData + (roi.y+i)*img->widthStep)
+			+ roi.x;
+		uint64_t *dst = m->bits + i*m->stride;
+
+		for (j=0; j<roi.width; j++) {
+			dst[j>>6] |= (uint64_t)(src[j] != 0) << (j&63);
+		}
+	}
+}
+
+/*!
+ * \brief Write the mask as a 0/255 image region.
+ *
+ * \param[in]   mask
+ * \param[out]  binary image
+ * \param[in]   region (mask size)
+ */
+void bitmask_to_image (xkin_bitmask *m, IplImage *img, CvRect roi)
+{
+	int i, j;
+
+	for (i=0; i<roi.height; i++) {
+		uint8_t *dst = (uint8_t*)(img->imageData + (roi.y+i)*img->widthStep)
+			+ roi.x;
+		const uint64_t *src = m->bits + i*m->stride;
+
+		for (j=0; j<roi.width; j++) {
+			dst[j] = -(uint8_t)((src[j>>6] >> (j&63)) & 1);
+		}
+	}
+}
+
+/*!
+ * \brief Smooth the mask: 3x3 median, open and close.
+ *
+ * Same operations of the opencv hand smoothing (cvSmooth CV_MEDIAN
+ * followed by CV_MOP_OPEN and CV_MOP_CLOSE with the centered 3x3
+ * ellipse, i.e. a cross). Outside the mask the median replicates the border,
+ * erosion and dilation ignore it. Every row goes through the five
+ * stages as soon as its neighbours are ready, the result is written
+ * over the mask rows that are not needed anymore.
+ *
+ * \param[in,out]  mask
+ */
+void bitmask_smooth (xkin_bitmask *m)
+{
+	static const row_op ops[NSTAGES] = {
+		median_row, erode_row, dilate_row, dilate_row, erode_row
+	};
+	pipeline p;
+	int i, k;
+
+	p.m = m;
+	p.y = 0;
+	for (k=0; k<NSTAGES; k++) {
+		p.st[k].op = ops[k];
+		p.st[k].prev = p.st[k].cur = NULL;
+		p.st[k].slot = 0;
+		for (i=0; i<RING; i++) {
+			p.st[k].out[i] = m->scratch + (k*RING + i)*m->stride;
+		}
+	}
+
+	for (i=0; i<m->height; i++) {
+		stage_push(&p, 0, m->bits + i*m->stride);
+	}
+	stage_push(&p, 0, NULL);
+}
+
+/*!
+ * \brief Add a mask row to the moments.
+ *
+ * The x sum of a word is the sum of its bit indices, counted bit plane
+ * by bit plane: bit b of the index is set in the positions selected by
+ * the mask idx[b].
+ *
+ * \param[in]      row
+ * \param[in]      words per row
+ * \param[in]      x of the first pixel
+ * \param[in]      y of the row
+ * \param[in,out]  moments
+ * \param[in,out]  bounding box (min x, min y, max x, max y)
+ */
+static void row_moments (const uint64_t *r, int stride, int x0, int y,
+			 xkin_moments *mo, int *bb)
+{
+	static const uint64_t idx[6] = {
+		0xaaaaaaaaaaaaaaaaULL, 0xccccccccccccccccULL,
+		0xf0f0f0f0f0f0f0f0ULL, 0xff00ff00ff00ff00ULL,
+		0xffff0000ffff0000ULL, 0xffffffff00000000ULL
+	};
+	int w, b, n=0, first=-1, last=-1;
+	double sx=0;
+
+	for (w=0; w<stride; w++) {
+		int c;
+
+		if (r[w] == 0)
+			continue;
+		if (first < 0)
+			first = w;
+		last = w;
+
+		c = __builtin_popcountll(r[w]);
+		n += c;
+		sx += (double)(x0 + 64*w) * c;
+		for (b=0; b<6; b++)
+			sx += (double)(__builtin_popcountll(r[w] & idx[b]) << b);
+	}
+	if (n == 0)
+		return;
+
+	mo->m00 += n;
+	mo->m10 += sx;
+	mo->m01 += (double)y * n;
+
+	if (x0 + first*64 + __builtin_ctzll(r[first]) < bb[0])
+		bb[0] = x0 + first*64 + __builtin_ctzll(r[first]);
+	if (x0 + last*64 + 63 - __builtin_clzll(r[last]) > bb[2])
+		bb[2] = x0 + last*64 + 63 - __builtin_clzll(r[last]);
+	if (bb[1] > y)
+		bb[1] = y;
+	bb[3] = y;
+}
+
+/*!
+ * \brief Feed a row to a stage (NULL ends the image).
+ *
+ * A stage outputs its current row when the next one arrives, then the
+ * output goes to the following stage. The last stage writes the mask.
+ */
+static void stage_push (pipeline *p, int k, const uint64_t *row)
+{
+	xkin_bitmask *m = p->m;
+	stage *s;
+	uint64_t *o;
+
+	if (k == NSTAGES) {
+		if (row != NULL)
+			memcpy(m->bits + (p->y++)*m->stride, row,
+			       sizeof(uint64_t) * m->stride);
+		return;
+	}
+
+	s = &(p->st[k]);
+	if (s->cur == NULL) {
+		if (row == NULL)
+			stage_push(p, k+1, NULL);
+		s->cur = row;
+		return;
+	}
+
+	o = s->out[s->slot];
+	s->slot = (s->slot + 1) % RING;
+	s->op(s->prev, s->cur, row, o, m->stride, m->width);
+
+	s->prev = s->cur;
+	s->cur = row;
+	stage_push(p, k+1, o);
+
+	if (row == NULL) {
+		s->prev = NULL;
+		stage_push(p, k+1, NULL);
+	}
+}
+
+/*!
+ * \brief Pixels x-1 of a word, fill is the pixel before the row.
+ */
+static inline uint64_t west (const uint64_t *r, int w, uint64_t fill)
+{
+	return (r[w] << 1) | (w > 0 ? r[w-1] >> 63 : fill);
+}
+
+/*!
+ * \brief Pixels x+1 of a word, fill is the pixel after the row.
+ */
+static inline uint64_t east (const uint64_t *r, int w, int n, int width,
+			     uint64_t fill)
+{
+	uint64_t e = r[w] >> 1;
+
+	if (w+1 < n)
+		e |= r[w+1] << 63;
+	else
+		e |= fill << ((width-1) & 63);
+
+	return e;
+}
+
+/*!
+ * \brief Valid bits of the last word of a row.
+ */
+static inline uint64_t last_word (int width)
+{
+	return (width & 63) ? ((uint64_t)1 << (width & 63)) - 1 : ~(uint64_t)0;
+}
+
+/*!
+ * \brief 3x3 median of a binary row (at least 5 of 9 pixels set).
+ *
+ * The three pixels of each row are summed in two bit planes, then the
+ * three sums are added with bit sliced full adders.
+ */
+static void median_row (const uint64_t *up, const uint64_t *c,
+			const uint64_t *down, uint64_t *out, int n, int width)
+{
+	const uint64_t *rows[3];
+	int w, k;
+
+	rows[0] = up != NULL ? up : c;
+	rows[1] = c;
+	rows[2] = down != NULL ? down : c;
+
+	for (w=0; w<n; w++) {
+		uint64_t s0[3], s1[3], t0, t1, t2, c0, c1, u0, u1, u2, u3, k0, k1;
+
+		for (k=0; k<3; k++) {
+			const uint64_t *r = rows[k];
+			uint64_t a = west(r, w, r[0] & 1);
+			uint64_t b = r[w];
+			uint64_t e = east(r, w, n, width,
+					  (r[n-1] >> ((width-1) & 63)) & 1);
+
+			s0[k] = a ^ b ^ e;
+			s1[k] = (a & b) | (e & (a ^ b));
+		}
+
+		t0 = s0[0] ^ s0[1];
+		c0 = s0[0] & s0[1];
+		t1 = s1[0] ^ s1[1] ^ c0;
+		c1 = (s1[0] & s1[1]) | (c0 & (s1[0] ^ s1[1]));
+		t2 = c1;
+
+		u0 = t0 ^ s0[2];
+		k0 = t0 & s0[2];
+		u1 = t1 ^ s1[2] ^ k0;
+		k1 = (t1 & s1[2]) | (k0 & (t1 ^ s1[2]));
+		u2 = t2 ^ k1;
+		u3 = t2 & k1;
+
+		out[w] = u3 | (u2 & (u1 | u0));
+	}
+	out[n-1] &= last_word(width);
+}
+
+/*!
+ * \brief Erosion of a row with the 3x3 cross.
+ */
+static void erode_row (const uint64_t *up, const uint64_t *c,
+		       const uint64_t *down, uint64_t *out, int n, int width)
+{
+	int w;
+
+	for (w=0; w<n; w++) {
+		uint64_t v = c[w] & west(c, w, 1) & east(c, w, n, width, 1);
+
+		if (up != NULL)
+			v &= up[w];
+		if (down != NULL)
+			v &= down[w];
+		out[w] = v;
+	}
+	out[n-1] &= last_word(width);
+}
+
+/*!
+ * \brief Dilation of a row with the 3x3 cross.
+ */
+static void dilate_row (const uint64_t *up, const uint64_t *c,
+			const uint64_t *down, uint64_t *out, int n, int width)
+{
+	int w;
+
+	for (w=0; w<n; w++) {
+		uint64_t v = c[w] | west(c, w, 0) | east(c, w, n, width, 0);
+
+		if (up != NULL)
+			v |= up[w];
+		if (down != NULL)
+			v |= down[w];
+		out[w] = v;
+	}
+	out[n-1] &= last_word(width);
+}
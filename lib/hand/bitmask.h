@@ -0,0 +1,11 @@
+#ifndef _BITMASK_H_
+#define _BITMASK_H_
+
+void         bitmask_reserve       (xkin_ctx*, xkin_bitmask*, int, int);
+void         bitmask_from_depth    (xkin_ctx*, xkin_bitmask*, IplImage*, CvRect, int,
+				    xkin_moments*);
+void         bitmask_from_image    (xkin_ctx*, xkin_bitmask*, IplImage*, CvRect);
+void         bitmask_to_image      (xkin_bitmask*, IplImage*, CvRect);
+void         bitmask_smooth        (xkin_bitmask*);
+
+#endif /* _BITMASK_H_ */
@@ -0,0 +1,273 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file blob.c
+ * \author Fabrizio Pedersoli
+ *
+ * Connected components of a bit packed mask. The mask is split in
+ * runs (horizontal segments of foreground pixels) read a word at a
+ * time, runs of consecutive rows are merged with a union-find
+ * (8-connectivity) and area, bounding box and centroid of every blob
+ * are accumulated over its runs.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+#include "blob.h"
+
+
+/*!
+ * \brief Horizontal run of foreground pixels.
+ */
+typedef struct run {
+	int y;                   //!< row
+	int x0;                  //!< first pixel
+	int x1;                  //!< last pixel (included)
+	int parent;              //!< union-find parent
+} run;
+
+/*!
+ * \brief Blob statistics, accumulated on the root run.
+ */
+typedef struct blob_stat {
+	int area;
+	int bb[4];               //!< min x, min y, max x, max y
+	double sx, sy;           //!< coordinate sums
+} blob_stat;
+
+
+static int         count_runs       (xkin_bitmask*);
+static int         row_runs         (const uint64_t*, int, int, int, run*);
+static int         find_root        (run*, int);
+static void        join             (run*, int, int);
+
+
+/*!
+ * \brief Keep only the largest blob of the mask.
+ *
+ * The blobs are labelled in one pass over the runs, the largest (by
+ * area) is written in the image region, which is cleared first. Blob
+ * coordinates are absolute.
+ *
+ * \param[in]   pipeline context (frame memory)
+ * \param[in]   mask of the region
+ * \param[out]  binary image
+ * \param[in]   region (mask size)
+ * \param[out]  largest blob
+ * \return      number of blobs
+ */
+int bitmask_largest_blob (xkin_ctx *ctx, xkin_bitmask *m, IplImage *img,
+			  CvRect roi, xkin_blob *b)
+{
+	run *runs;
+	blob_stat *st;
+	int i, y, n=0, prev=0, prev_n=0, blobs=0, best=-1;
+
+	memset(b, 0, sizeof(xkin_blob));
+
+	if (m->width == 0 || m->height == 0 || (n = count_runs(m)) == 0)
+		return 0;
+
+	runs = (run*)xkin_alloc(ctx, sizeof(run) * n);
+	st = (blob_stat*)xkin_alloc(ctx, sizeof(blob_stat) * n);
+
+	n = 0;
+	for (y=0; y<m->height; y++) {
+		int cur = n, k = prev, num;
+
+		num = row_runs(m->bits + y*m->stride, m->width, m->stride, y,
+			       runs + n);
+
+		/* runs of the two rows are sorted, overlap with 8-connectivity */
+		for (i=cur; i<cur+num; i++) {
+			while (k < prev+prev_n && runs[k].x1+1 < runs[i].x0)
+				k++;
+			while (k < prev+prev_n && runs[k].x0 <= runs[i].x1+1) {
+				join(runs, i, k);
+				k++;
+			}
+			if (k > prev)
+				k--;
+		}
+
+		prev = cur;
+		prev_n = num;
+		n += num;
+	}
+
+	for (i=0; i<n; i++) {
+		int r = find_root(runs, i), len = runs[i].x1 - runs[i].x0 + 1;
+
+		if (r == i) {
+			st[r].area = 0;
+			st[r].bb[0] = runs[i].x0;
+			st[r].bb[1] = runs[i].y;
+			st[r].bb[2] = runs[i].x1;
+			st[r].bb[3] = runs[i].y;
+			st[r].sx = st[r].sy = 0;
+			blobs++;
+		}
+		st[r].area += len;
+		st[r].sx += (double)(runs[i].x0 + runs[i].x1) * len / 2;
+		st[r].sy += (double)runs[i].y * len;
+		if (runs[i].x0 < st[r].bb[0])
+			st[r].bb[0] = runs[i].x0;
+		if (runs[i].x1 > st[r].bb[2])
+			st[r].bb[2] = runs[i].x1;
+		if (runs[i].y > st[r].bb[3])
+			st[r].bb[3] = runs[i].y;
+
+		if (best < 0 || st[r].area > st[best].area)
+			best = r;
+	}
+
+	b->area = st[best].area;
+	b->bbox = cvRect(roi.x + st[best].bb[0], roi.y + st[best].bb[1],
+			 st[best].bb[2] - st[best].bb[0] + 1,
+			 st[best].bb[3] - st[best].bb[1] + 1);
+	b->centroid = cvPoint2D32f(roi.x + st[best].sx / b->area,
+				   roi.y + st[best].sy / b->area);
+
+	for (y=0; y<roi.height; y++) {
+		memset(img->imageData + (roi.y+y)*img->widthStep + roi.x, 0,
+		       roi.width);
+	}
+	for (i=0; i<n; i++) {
+		if (find_root(runs, i) != best)
+			continue;
+		memset(img->imageData + (roi.y+runs[i].y)*img->widthStep +
+		       roi.x + runs[i].x0, 255, runs[i].x1 - runs[i].x0 + 1);
+	}
+
+	return blobs;
+}
+
+/*!
+ * \brief Number of runs of the mask (one per run start bit).
+ */
+static int count_runs (xkin_bitmask *m)
+{
+	int y, w, n=0;
+
+	for (y=0; y<m->height; y++) {
+		const uint64_t *r = m->bits + y*m->stride;
+		uint64_t carry = 0;
+
+		for (w=0; w<m->stride; w++) {
+			n += __builtin_popcountll(r[w] & ~((r[w] << 1) | carry));
+			carry = r[w] >> 63;
+		}
+	}
+
+	return n;
+}
+
+/*!
+ * \brief Extract the runs of a mask row.
+ *
+ * \param[in]   mask row
+ * \param[in]   width
+ * \param[in]   words per row
+ * \param[in]   row index
+ * \param[out]  runs
+ * \return      number of runs
+ */
+static int row_runs (const uint64_t *r, int width, int stride, int y, run *dst)
+{
+	int x=0, n=0;
+
+	while (x < width) {
+		int w = x >> 6, x0, x1;
+		uint64_t v = r[w] & (~(uint64_t)0 << (x & 63));
+
+		while (v == 0 && ++w < stride)
+			v = r[w];
+		if (w >= stride)
+			break;
+		x0 = w*64 + __builtin_ctzll(v);
+
+		w = x0 >> 6;
+		v = ~r[w] & (~(uint64_t)0 << (x0 & 63));
+		while (v == 0 && ++w < stride)
+			v = ~r[w];
+		x1 = (w < stride ? w*64 + __builtin_ctzll(v) : stride*64) - 1;
+		if (x1 >= width)
+			x1 = width-1;
+
+		dst[n].y = y;
+		dst[n].x0 = x0;
+		dst[n].x1 = x1;
+		dst[n].parent = -1;
+		n++;
+
+		x = x1 + 2;
+	}
+
+	return n;
+}
+
+static int find_root (run *runs, int i)
+{
+	int r = i;
+
+	while (runs[r].parent >= 0)
+		r = runs[r].parent;
+	while (runs[i].parent >= 0) {
+		int next = runs[i].parent;
+
+		runs[i].parent = r;
+		i = next;
+	}
+
+	return r;
+}
+
+/*!
+ * \brief Merge two blobs, the root is the run with the lower index.
+ */
+static void join (run *runs, int a, int b)
+{
+	a = find_root(runs, a);
+	b = find_root(runs, b);
+
+	if (a < b)
+		runs[b].parent = a;
+	else if (b < a)
+		runs[a].parent = b;
+}
@@ -0,0 +1,6 @@
+#ifndef _BLOB_H_
+#define _BLOB_H_
+
+int          bitmask_largest_blob  (xkin_ctx*, xkin_bitmask*, IplImage*, CvRect, xkin_blob*);
+
+#endif /* _BLOB_H_ */
@@ -41,9 +41,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <math.h>
 #include <opencv2/core/core_c.h>
 
+#include "libxkin.h"
 #include "const.h"
 #include "clustering.h"
 
@@ -51,7 +54,11 @@
 static int            init_step                 (CvMat*, CvMat*, CvMat*);
 static int            assignment_step           (double, CvMat*);
 static void           update_step               (double, int, CvMat*, CvMat*);
-static void           fill_mat                  (IplImage*, CvMat*);
+static void           fill_mat                  (IplImage*, CvRect, CvMat*);
+static unsigned int   depth_histogram           (IplImage*, CvRect, unsigned int*, int*, int*);
+static double         lloyd_clustering          (unsigned int*, int, int);
+static double         otsu_clustering           (unsigned int*, int, int);
+static float          online_clustering         (IplImage*, CvRect, int, int);
 /* static void           mk_partition              (CvMat*, CvMat*, CvMat*); */
 /* static int            get_cluster_var           (CvMat*, CvMat*); */
 
@@ -62,33 +69,216 @@ static void           fill_mat                  (IplImage*, CvMat*);
  * Starting from the depth body image this function computes the depth
  * interval related to the hand, these two depth values are later used
  * as thresholds for the binarization procedure. This interval is
- * calculated through a K-means clustering of the body image.
+ * calculated through a 2-means clustering of the body depth values,
+ * the hand being the nearest cluster. Only the pixels within the
+ * region of interest are considered.
  *
- * \param[in]      body depth image
+ * The clustering is done on the depth histogram (O(bins) per
+ * iteration) except for XKIN_CLUSTER_ONLINE which replays the original
+ * online k-means pixel by pixel and gives exactly its results.
+ *
+ * \param[in]   body depth image (8 or 16 bit)
+ * \param[in]   region of interest
+ * \param[in]   clustering method (XKIN_CLUSTER_*)
  * \param[out]  hand depth min max values 
  */
-void get_hand_interval (IplImage *body, int *interval)
+void get_hand_interval (IplImage *body, CvRect roi, int method, int *interval)
 {
-	CvMat  *data, *par, *means;
-	double var;
-	int    min, count = cvCountNonZero(body);
+	unsigned int hist[HIST_BINS];
+	int min, max;
+	double mean;
 
-	data  = cvCreateMat(count, 1, CV_32FC1);
-	par   = cvCreateMat(count, 1, CV_8UC1);
-	means = cvCreateMat(K, 1, CV_32FC1);
+	if (depth_histogram(body, roi, hist, &min, &max) == 0) {
+		interval[0] = interval[1] = 0;
+		return;
+	}
 
-	fill_mat(body, data);
+	switch (method) {
+	case XKIN_CLUSTER_ONLINE:
+		mean = online_clustering(body, roi, min, max);
+		break;
+	case XKIN_CLUSTER_OTSU:
+		mean = otsu_clustering(hist, min, max);
+		break;
+	default:
+		mean = lloyd_clustering(hist, min, max);
+		break;
+	}
 
-	min = kmeans_clustering(data, means, par);
+	interval[0] = min;
+	interval[1] = (int)mean;
+}
 
-	//var = get_cluster_var(data, par);
+/*!
+ * \brief Histogram of the non zero depth values.
+ *
+ * \param[in]   body depth image (8 or 16 bit, values below HIST_BINS)
+ * \param[in]   region of interest
+ * \param[out]  histogram (HIST_BINS counts)
+ * \param[out]  min non zero value
+ * \param[out]  max value
+ * \return      number of non zero pixels
+ */
+static unsigned int depth_histogram (IplImage *img, CvRect roi,
+				     unsigned int *hist, int *min, int *max)
+{
+	unsigned int count=0;
+	int i, j;
 
-	interval[0] = min;
-	interval[1] = (int)cvmGet(means, 0, 0); //- var;
+	memset(hist, 0, sizeof(unsigned int) * HIST_BINS);
 
-	cvReleaseMat(&data);
-	cvReleaseMat(&par);
-	cvReleaseMat(&means);
+	for (i=roi.y; i<roi.y+roi.height; i++) {
+		char *row = img->imageData + i*img->widthStep;
+
+		if (img->depth == IPL_DEPTH_16U) {
+			for (j=roi.x; j<roi.x+roi.width; j++) {
+				uint16_t v = ((uint16_t*)row)[j];
+
+				hist[v < HIST_BINS ? v : HIST_BINS-1]++;
+			}
+		} else {
+			for (j=roi.x; j<roi.x+roi.width; j++) {
+				hist[((uint8_t*)row)[j]]++;
+			}
+		}
+	}
+
+	*min = *max = 0;
+	for (j=1; j<HIST_BINS; j++) {
+		if (hist[j] == 0)
+			continue;
+		if (*min == 0)
+			*min = j;
+		*max = j;
+		count += hist[j];
+	}
+
+	return count;
+}
+
+/*!
+ * \brief Weighted Lloyd 2-means on a histogram.
+ *
+ * Means start at the min and max value, every bin is assigned to the
+ * nearest mean (the first on ties) and the means are recomputed until
+ * they don't change.
+ *
+ * \param[in]  histogram
+ * \param[in]  min non empty bin
+ * \param[in]  max non empty bin
+ * \return     mean of the first (nearest) cluster
+ */
+static double lloyd_clustering (unsigned int *hist, int min, int max)
+{
+	double m[K] = {min, max};
+	int i, v;
+
+	for (i=0; i<KMEANS_ITER; i++) {
+		double sum[K] = {0, 0}, w[K] = {0, 0}, n0, n1;
+
+		for (v=min; v<=max; v++) {
+			int c = fabs(v - m[0]) <= fabs(v - m[1]) ? 0 : 1;
+
+			sum[c] += (double)v * hist[v];
+			w[c] += hist[v];
+		}
+
+		n0 = w[0] > 0 ? sum[0]/w[0] : m[0];
+		n1 = w[1] > 0 ? sum[1]/w[1] : m[1];
+		if (n0 == m[0] && n1 == m[1])
+			break;
+		m[0] = n0;
+		m[1] = n1;
+	}
+
+	return m[0];
+}
+
+/*!
+ * \brief Exact 2 class Otsu threshold on a histogram.
+ *
+ * The threshold t maximizes the between class variance of the classes
+ * [min,t] and (t,max].
+ *
+ * \param[in]  histogram
+ * \param[in]  min non empty bin
+ * \param[in]  max non empty bin
+ * \return     mean of the first (nearest) class
+ */
+static double otsu_clustering (unsigned int *hist, int min, int max)
+{
+	double total=0, sum=0, w0=0, s0=0, best=-1, mean=min;
+	int t;
+
+	for (t=min; t<=max; t++) {
+		total += hist[t];
+		sum += (double)t * hist[t];
+	}
+
+	for (t=min; t<max; t++) {
+		double w1, m0, m1, b;
+
+		w0 += hist[t];
+		s0 += (double)t * hist[t];
+		w1 = total - w0;
+		if (w0 == 0 || w1 == 0)
+			continue;
+
+		m0 = s0 / w0;
+		m1 = (sum - s0) / w1;
+		b = w0 * w1 * (m0 - m1) * (m0 - m1);
+		if (b > best) {
+			best = b;
+			mean = m0;
+		}
+	}
+
+	return mean;
+}
+
+/*!
+ * \brief Original online k-means, without matrices.
+ *
+ * Same arithmetic of kmeans_clustering (means and weights stored as
+ * float, updates in double) on the pixels in raster order.
+ *
+ * \param[in]  body depth image
+ * \param[in]  region of interest
+ * \param[in]  min non zero value
+ * \param[in]  max value
+ * \return     mean of the first (nearest) cluster
+ */
+static float online_clustering (IplImage *img, CvRect roi, int min, int max)
+{
+	float means[K] = {min, max}, weights[K] = {1, 1};
+	int i, j;
+
+	for (i=roi.y; i<roi.y+roi.height; i++) {
+		char *row = img->imageData + i*img->widthStep;
+
+		for (j=roi.x; j<roi.x+roi.width; j++) {
+			double val, cur, w;
+			int idx;
+
+			if (img->depth == IPL_DEPTH_16U)
+				val = ((uint16_t*)row)[j];
+			else
+				val = ((uint8_t*)row)[j];
+			if (val == 0)
+				continue;
+
+			idx = fabs(val - means[1]) < fabs(val - means[0]) ? 1 : 0;
+
+			cur = means[idx];
+			w = weights[idx];
+			cur = (cur*w + val)/(w+1);
+			w += 1;
+			means[idx] = (float)cur;
+			weights[idx] = (float)w;
+		}
+	}
+
+	return means[0];
 }
 
 void get_hand_interval_2 (IplImage *body, int *interval)
@@ -103,7 +293,7 @@ void get_hand_interval_2 (IplImage *body, int *interval)
 	labels = cvCreateMat(count, 1, CV_32SC1);
 	means = cvCreateMat(CLUSTERS, 1, CV_32FC1);
 
-	fill_mat(body, data);
+	fill_mat(body, cvRect(0, 0, body->width, body->height), data);
 	cvKMeans2(data, CLUSTERS, labels,
 		  cvTermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 10, 10.0),
 		  1, 0, 0, means, 0);
@@ -116,6 +306,7 @@ void get_hand_interval_2 (IplImage *body, int *interval)
 		  
 	cvReleaseMat(&data);
 	cvReleaseMat(&labels);
+	cvReleaseMat(&means);
 }
 
 /*!
@@ -146,6 +337,8 @@ int kmeans_clustering (CvMat *data, CvMat *means, CvMat *par)
 
 	//mk_partition(data, par, means);
 
+	cvReleaseMat(&weights);
+
 	return min;
 }
 
@@ -249,16 +442,23 @@ static void update_step (double val, int idx, CvMat *means, CvMat *weights)
 /* 	return (int)sdv.val[0]; */
 /* } */
 
-static void fill_mat (IplImage *img, CvMat *data)
+static void fill_mat (IplImage *img, CvRect roi, CvMat *data)
 {
-	int i,j=0;
+	int i,k,j=0;
 	float val;
 
-	for (i=0; i< img->width*img->height; i++) {
-		val = (float)((uint8_t*)img->imageData)[i];
+	for (i=roi.y; i<roi.y+roi.height; i++) {
+		char *row = img->imageData + i*img->widthStep;
+
+		for (k=roi.x; k<roi.x+roi.width; k++) {
+			if (img->depth == IPL_DEPTH_16U)
+				val = (float)((uint16_t*)row)[k];
+			else
+				val = (float)((uint8_t*)row)[k];
 
-		if (val != 0) {
-			cvmSet(data, j++, 0, val);
+			if (val != 0) {
+				cvmSet(data, j++, 0, val);
+			}
 		}
 	}
 }
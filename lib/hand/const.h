@@ -10,7 +10,23 @@ enum {
 	NBINS=16,
 	K=2,
 	MAX_COUNT=15,
+	HAND_MARGIN=2,
+	HAND_MARGIN_NATIVE=16,
+	ROI_MARGIN=4,
+	HIST_BINS=2048,
+	KMEANS_ITER=32,
+	REG_STEP=16,
+	REG_DILATE=2,
+	SKIN_LUT_BINS=32,
+	SKIN_LUT_SIZE=32*32*32,
+	SKIN_BOX=7,
+	TRACK_HAND_MARGIN=16,
 };
 
+#define TRACK_HAND_SCALE        1.5
+#define TRACK_HAND_RATIO        0.5
+#define TRACK_ALPHA             0.75
+#define TRACK_BETA              0.35
+
 #endif /* _CONST_H_ */
 
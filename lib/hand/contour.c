@@ -45,20 +45,33 @@
 #include <opencv2/core/core_c.h>
 #include <opencv2/imgproc/imgproc_c.h>
 
+#include "libxkin.h"
 #include "const.h"
 #include "contour.h"
 #include "transform.h"
+#include "registration.h"
+#include "skin.h"
+#include "filter.h"
+#include "bitmask.h"
+#include "blob.h"
 #include "visualiz.h"
 
 
-static CvSeq*           get_hand_contour                  (IplImage*);
-static void             morphological_smooth              (IplImage*);
-static CvSeq*           get_largest_contour               (CvSeq*);
-static CvPoint          get_contour_centroid              (CvSeq*);
+static xkin_contour*    get_hand_contour                  (xkin_ctx*, IplImage*, CvRect,
+							   CvPoint);
+static int              get_hand_contour_basic_int        (xkin_ctx*, IplImage*, CvRect*,
+							   xkin_contour**, CvPoint*);
+static int              get_hand_contour_advanced_int     (xkin_ctx*, IplImage*, IplImage*,
+							   int, CvRect*, xkin_contour**,
+							   CvPoint*);
+static void             morphological_smooth              (xkin_ctx*, IplImage*);
+static IplConvKernel*   get_strel                         (xkin_ctx*);
+static CvPoint          get_blob_centroid                 (xkin_hand*, CvPoint);
 static CvPoint          get_hand_centroid                 (IplImage*);
 static CvPoint          get_bounding_box_centroid         (CvSeq*);
-static IplImage*        hand_rgb_segmentation             (IplImage*, CvRect);
-static void             contour_add_offset                (CvSeq*, CvRect);
+static IplImage*        hand_rgb_segmentation             (xkin_ctx*, IplImage*, CvRect);
+static CvSeq*           contour_to_seq                    (xkin_ctx*, xkin_contour*);
+static CvRect           hand_region                       (xkin_ctx*, IplImage*, CvRect*);
 
 
 /*!
@@ -77,12 +90,63 @@ static void             contour_add_offset                (CvSeq*, CvRect);
  */
 int get_hand_contour_basic (IplImage *hand, CvSeq **dst, CvPoint *cent)
 {
-	if ((*dst = get_hand_contour(hand)) == NULL) {
+	xkin_ctx *ctx = xkin_default_ctx();
+	xkin_contour *cnt;
+
+	if (!get_hand_contour_basic_int(ctx, hand, NULL, &cnt, cent))
+		return 0;
+
+	*dst = contour_to_seq(ctx, cnt);
+
+	return 1;
+}
+
+/*!
+ * \brief Extract the hand contour and centroid in the binary hand
+ * image using a pipeline context.
+ *
+ * The contour is stored in the context (ctx->hand.contour) and it is
+ * valid until the next call. Only the region given by the body
+ * bounding box is processed (for the context hand image the region
+ * written by hand_detection_ctx), contour coordinates are anyway
+ * absolute.
+ *
+ * \param[in]       pipeline context
+ * \param[in]       binary hand image
+ * \param[in]       body bounding box (NULL for the whole image)
+ * \param[in,out]   hand's contour (basic contour)
+ * \param[in,out]   hand's centroid
+ * \return          corrent detection (1) 
+ */
+int get_hand_contour_basic_ctx (xkin_ctx *ctx, IplImage *hand, CvRect *roi,
+				xkin_contour **dst, CvPoint *cent)
+{
+	return get_hand_contour_basic_int(ctx, hand, roi, dst, cent);
+}
+
+/*!
+ * \brief Basic contour extraction, shared by the sequence and the
+ * flat contour interfaces.
+ *
+ * \param[in]       pipeline context
+ * \param[in]       binary hand image
+ * \param[in]       body bounding box (NULL for the whole image)
+ * \param[in,out]   hand's contour (basic contour)
+ * \param[in,out]   hand's centroid
+ * \return          corrent detection (1) 
+ */
+static int get_hand_contour_basic_int (xkin_ctx *ctx, IplImage *hand,
+				       CvRect *roi, xkin_contour **dst,
+				       CvPoint *cent)
+{
+	CvRect r = hand_region(ctx, hand, roi);
+
+	if ((*dst = get_hand_contour(ctx, hand, r, cvPoint(0, 0))) == NULL) {
 		return 0;
 	}
 
 	if (cent != NULL) {
-		*cent = get_contour_centroid(*dst); 
+		*cent = get_blob_centroid(&(ctx->hand), cvPoint(0, 0));
 	}
 
 	return 1;
@@ -108,16 +172,80 @@ int get_hand_contour_basic (IplImage *hand, CvSeq **dst, CvPoint *cent)
 int get_hand_contour_advanced (IplImage *hand, IplImage *rgb, int z,
 			       CvSeq **dst, CvPoint *cent)
 {
-	CvRect bb;
-	IplImage *asd;
+	xkin_ctx *ctx = xkin_default_ctx();
+	xkin_contour *cnt;
+
+	if (!get_hand_contour_advanced_int(ctx, hand, rgb, z, NULL, &cnt, cent))
+		return 0;
 
-	asd = cvCloneImage(hand);
+	*dst = contour_to_seq(ctx, cnt);
+
+	return 1;
+}
+
+/*!
+ * \brief Extract the hand contour and centroid within a ROI in the
+ * color image using a pipeline context.
+ *
+ * In XKIN_DEPTH_NATIVE mode z is in millimetres, so the depth to
+ * color mapping is done at the real hand distance. The hand image is
+ * not modified, the color segmentation images are frame memory.
+ *
+ * With ctx->hand.registered set the color segmentation is restricted
+ * to the depth hand blob mapped in the color image.
+ *
+ * \param[in]      pipeline context
+ * \param[in]      binary hand depth image
+ * \param[in]      kinect color image
+ * \param[in]      depth of the hand (needed for depth -> color bb map)
+ * \param[in]      body bounding box (NULL for the whole image)
+ * \param[in,out]  hand's contour (avdanced contour) 
+ * \param[in,out]  hand's centroid
+ * \return         correnct classification (1)
+ */
+int get_hand_contour_advanced_ctx (xkin_ctx *ctx, IplImage *hand,
+				   IplImage *rgb, int z, CvRect *roi,
+				   xkin_contour **dst, CvPoint *cent)
+{
+	return get_hand_contour_advanced_int(ctx, hand, rgb, z, roi, dst, cent);
+}
 
-	if ((*dst = get_hand_contour(asd)) == NULL) {
+/*!
+ * \brief Advanced contour extraction, shared by the sequence and the
+ * flat contour interfaces.
+ *
+ * \param[in]      pipeline context
+ * \param[in]      binary hand depth image
+ * \param[in]      kinect color image
+ * \param[in]      depth of the hand (needed for depth -> color bb map)
+ * \param[in]      body bounding box (NULL for the whole image)
+ * \param[in,out]  hand's contour (avdanced contour) 
+ * \param[in,out]  hand's centroid
+ * \return         correnct classification (1)
+ */
+static int get_hand_contour_advanced_int (xkin_ctx *ctx, IplImage *hand,
+					  IplImage *rgb, int z, CvRect *roi,
+					  xkin_contour **dst, CvPoint *cent)
+{
+	xkin_hand *s = &(ctx->hand);
+	CvRect bb, r = hand_region(ctx, hand, roi);
+	IplImage *asd, *depth;
+	int zmm;
+
+	depth = asd = xkin_image(ctx, &(s->work), cvGetSize(hand), 8, 1);
+	cvSetImageROI(hand, r);
+	cvSetImageROI(asd, r);
+	cvCopy(hand, asd, NULL);
+	cvResetImageROI(hand);
+	cvResetImageROI(asd);
+
+	if ((*dst = get_hand_contour(ctx, asd, r, cvPoint(0, 0))) == NULL) {
 		return 0;
 	}
 
-	bb = get_rgb_hand_bbox_from_depth(*dst, z);
+	/* in 8 bit mode the depth value is taken as metres */
+	zmm = ctx->depth_mode == XKIN_DEPTH_NATIVE ? z : z*1000;
+	bb = get_rgb_hand_bbox_from_depth(ctx, s->blob.bbox, zmm);
 
 	if (bb.x<0 || bb.y<0 ||
 	    bb.x+bb.width > hand->width ||
@@ -125,20 +253,28 @@ int get_hand_contour_advanced (IplImage *hand, IplImage *rgb, int z,
 		return 0;
 	}
 	
-	asd = hand_rgb_segmentation(rgb, bb);
+	asd = hand_rgb_segmentation(ctx, rgb, bb);
 
-	if ((*dst = get_hand_contour(asd)) == NULL) {
-		return 0;
+	if (s->registered) {
+		IplImage *reg = xkin_alloc_image(ctx, cvGetSize(asd), 8, 1);
+
+		cvZero(reg);
+		registration_map_mask(ctx, depth, s->blob.bbox, zmm, reg,
+				      cvPoint(bb.x, bb.y));
+		cvDilate(reg, reg, get_strel(ctx), REG_DILATE);
+		cvAnd(asd, reg, asd, NULL);
 	}
 
-	contour_add_offset(*dst, bb);
+	if ((*dst = get_hand_contour(ctx, asd, cvRect(0, 0, bb.width,
+						      bb.height),
+				     cvPoint(bb.x, bb.y))) == NULL) {
+		return 0;
+	}
 
 	if (cent != NULL) {
-		*cent = get_contour_centroid(*dst);
+		*cent = get_blob_centroid(s, cvPoint(bb.x, bb.y));
 	}
 
-	cvReleaseImage(&asd);
-	
 	return 1;
 }
 
@@ -146,31 +282,62 @@ int get_hand_contour_advanced (IplImage *hand, IplImage *rgb, int z,
  * \brief Core precedure for finding the hand contour.
  *
  * This is the base of get_hand_contour_basic, here is done the
- * proper contour extraction.
+ * proper contour extraction. After the smoothing the connected
+ * components of the mask are labelled and only the largest one (by
+ * area) is kept in the image and traced. The blob is stored in
+ * ctx->hand.blob, the contour in ctx->hand.contour.
  *
+ * \param[in]  pipeline context
  * \param[in]  binary hand image
+ * \param[in]  region to process
+ * \param[in]  offset added to the contour points
  * \return     hand's contour 
  */
-CvSeq* get_hand_contour (IplImage *hand)
+static xkin_contour* get_hand_contour (xkin_ctx *ctx, IplImage *hand,
+				       CvRect roi, CvPoint off)
 {
-	CvSeq *contours, *contour;
-	CvPoint cent;
-	static CvMemStorage *str = NULL;
-
-	if (str==NULL) {
-		str = cvCreateMemStorage(0);
+	xkin_hand *s = &(ctx->hand);
+	CvSeq *contours = NULL;
+	CvRect r;
+	int x1, y1;
+
+	if (s->storage==NULL) {
+		s->storage = cvCreateMemStorage(0);
+		ctx->allocs++;
 	} else {
-		cvClearMemStorage(str);
+		cvClearMemStorage(s->storage);
 	}
 
-	morphological_smooth(hand);
-	cvFindContours(hand, str, &contours, sizeof(CvContour),
+	cvSetImageROI(hand, roi);
+	morphological_smooth(ctx, hand);
+	cvResetImageROI(hand);
+
+	if (bitmask_largest_blob(ctx, &(s->mask), hand, roi, &(s->blob)) == 0)
+		return NULL;
+
+	/* trace only the blob, with one background pixel around it */
+	r = s->blob.bbox;
+	x1 = r.x + r.width + 1 > roi.x + roi.width ?
+		roi.x + roi.width : r.x + r.width + 1;
+	y1 = r.y + r.height + 1 > roi.y + roi.height ?
+		roi.y + roi.height : r.y + r.height + 1;
+	r.x = r.x - 1 < roi.x ? roi.x : r.x - 1;
+	r.y = r.y - 1 < roi.y ? roi.y : r.y - 1;
+	r.width = x1 - r.x;
+	r.height = y1 - r.y;
+
+	cvSetImageROI(hand, r);
+	cvFindContours(hand, s->storage, &contours, sizeof(CvContour),
 		       CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE,
-		       cvPoint(0,0));
+		       cvPoint(r.x + off.x, r.y + off.y));
+	cvResetImageROI(hand);
+
+	if (contours == NULL)
+		return NULL;
 
-	contour = get_largest_contour(contours);
+	ctx->allocs += xkin_contour_from_seq(&(s->contour), contours);
 
-	return contour;
+	return &(s->contour);
 }
 
 /*!
@@ -182,55 +349,84 @@ CvSeq* get_hand_contour (IplImage *hand)
  * image. This procedure return a new hand binary image computed in
  * the color space.
  *
+ * By default the color ROI is classified in place through a color
+ * table (see skin.c), with XKIN_SEG_OPENCV it is copied and converted
+ * to YCrCb and Cr is filtered, with the filters of filter.c unless
+ * ctx->hand.smoothing is XKIN_SMOOTH_OPENCV.
+ *
+ * \param[in]  pipeline context
  * \param[in]  kinect color image 
  * \param[in]  hand's bounding box (in depth) 
- * \return     binary hand (from) color image 
+ * \return     binary hand (from) color image (frame memory)
  */
-static IplImage *hand_rgb_segmentation (IplImage* rgb, CvRect roi)
+static IplImage *hand_rgb_segmentation (xkin_ctx *ctx, IplImage* rgb,
+					CvRect roi)
 {
 	IplImage *tmp, *asd;
-	IplConvKernel *strel;
 
-	tmp = cvCreateImage(cvSize(roi.width,roi.height), 8, 3);
-	asd = cvCreateImage(cvSize(roi.width,roi.height), 8, 1);
+	asd = xkin_alloc_image(ctx, cvSize(roi.width,roi.height), 8, 1);
+
+	if (ctx->hand.segmentation == XKIN_SEG_LUT) {
+		skin_segmentation(ctx, rgb, roi, asd);
+		cvMorphologyEx(asd, asd, NULL, get_strel(ctx), CV_MOP_CLOSE, 3);
+		return asd;
+	}
+
+	tmp = xkin_alloc_image(ctx, cvSize(roi.width,roi.height), 8, 3);
 	
 	cvSetImageROI(rgb, roi);
 	cvCopy(rgb, tmp, NULL);
 	cvResetImageROI(rgb);
 	cvCvtColor(tmp, tmp, CV_RGB2YCrCb);
 	cvSplit(tmp, NULL, NULL, asd, NULL);
-	cvSmooth(asd, asd, CV_GAUSSIAN, 7, 7, 0, 0);
-	cvSmooth(asd, asd, CV_MEDIAN, 7, 7, 0 ,0);
+	if (ctx->hand.smoothing == XKIN_SMOOTH_OPENCV) {
+		cvSmooth(asd, asd, CV_GAUSSIAN, 7, 7, 0, 0);
+		cvSmooth(asd, asd, CV_MEDIAN, 7, 7, 0 ,0);
+	} else {
+		filter_gaussian7(ctx, asd, asd);
+		filter_median7(ctx, asd, asd);
+	}
 	cvThreshold(asd, asd, 0, 255, CV_THRESH_OTSU);
-	strel = cvCreateStructuringElementEx(3,3,0,0,CV_SHAPE_ELLIPSE, NULL);
-	cvMorphologyEx(asd, asd, NULL, strel, CV_MOP_CLOSE, 3);
-
-	cvReleaseImage(&tmp);
+	cvMorphologyEx(asd, asd, NULL, get_strel(ctx), CV_MOP_CLOSE, 3);
 
 	return asd;
 }
 
 /*!
- * \brief Convert a contour from a ROI relative coordinates to
- * absolute coordinates. 
+ * \brief Contour as a sequence, for the legacy interface.
+ *
+ * The sequence lives in the contours storage, so it is valid until
+ * the next contour extraction.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  hand's contour
+ * \return     hand's contour sequence
+ */
+static CvSeq *contour_to_seq (xkin_ctx *ctx, xkin_contour *cnt)
+{
+	return xkin_contour_to_seq(cnt, ctx->hand.storage);
+}
+
+/*!
+ * \brief Region of the hand image to process.
  *
- * It is added the top left corner coordinate of the bounding box to
- * each point of the contour sequence to recover the absolute
- * coordinate. 
+ * For the context hand image this is the region written by
+ * hand_detection_ctx (the rest is empty), so a tracked hand window is
+ * not enlarged to the body box.
  *
- * \param[in,out] hand's contour
- * \param[in] hand's color (transformed from depth) bounding box
+ * \param[in]  pipeline context
+ * \param[in]  binary hand image
+ * \param[in]  body bounding box (NULL for the whole image)
+ * \return     region
  */
-static void contour_add_offset (CvSeq *cnt, CvRect roi)
+static CvRect hand_region (xkin_ctx *ctx, IplImage *hand, CvRect *roi)
 {
-	int i;
+	xkin_hand *s = &(ctx->hand);
 
-	for (i=0; i<cnt->total; i++) {
-		CvPoint *p = (CvPoint*)cvGetSeqElem(cnt, i);
+	if (hand == s->hand && s->roi.width > 0 && s->roi.height > 0)
+		return s->roi;
 
-		p->x += roi.x;
-		p->y += roi.y;
-	}
+	return clip_roi(roi, cvGetSize(hand), ROI_MARGIN);
 }
 
 /*!
@@ -240,73 +436,76 @@ static void contour_add_offset (CvSeq *cnt, CvRect roi)
  * in the binary image with a median filter. The latter is to smooth
  * the hand shape with an morpholocial open and close.
  *
+ * With XKIN_MORPH_PACKED the three operations run on the bit packed
+ * mask of the image ROI (the one built by hand_detection_ctx when the
+ * image is the context hand image) and the image is not written.
+ * Otherwise the image is smoothed and then packed. In both cases the
+ * result is the context mask.
+ *
+ * \param[in]      pipeline context
  * \param[in,out]  hand binary image
  */
-static void morphological_smooth (IplImage *hand)
+static void morphological_smooth (xkin_ctx *ctx, IplImage *hand)
 {
-	IplConvKernel *elem;
-	static IplImage *tmp=NULL;
+	xkin_hand *s = &(ctx->hand);
 
-	if (tmp==NULL) {
-		tmp = cvCreateImage(cvGetSize(hand), 8, 1);
-	} else {
-		cvZero(tmp);
+	if (s->morphology == XKIN_MORPH_PACKED) {
+		CvRect r = cvGetImageROI(hand);
+
+		if (!s->mask_valid || hand != s->hand ||
+		    r.x != s->roi.x || r.y != s->roi.y ||
+		    r.width != s->roi.width || r.height != s->roi.height)
+			bitmask_from_image(ctx, &(s->mask), hand, r);
+
+		bitmask_smooth(&(s->mask));
+		s->mask_valid = 0;
+		return;
 	}
 
 	cvSmooth(hand, hand, CV_MEDIAN, MEDIAN_DIM, MEDIAN_DIM, 0, 0);
-	elem = cvCreateStructuringElementEx(3, 3, 0, 0,
-					    CV_SHAPE_ELLIPSE, NULL);
 
-	cvMorphologyEx(hand, hand, tmp, elem, CV_MOP_OPEN, N_ITER);
-	cvMorphologyEx(hand, hand, tmp, elem, CV_MOP_CLOSE, N_ITER);
+	/* open and close need no temporary image */
+	cvMorphologyEx(hand, hand, NULL, get_strel(ctx), CV_MOP_OPEN, N_ITER);
+	cvMorphologyEx(hand, hand, NULL, get_strel(ctx), CV_MOP_CLOSE, N_ITER);
+
+	bitmask_from_image(ctx, &(s->mask), hand, cvGetImageROI(hand));
+	s->mask_valid = 0;
 }
 
 /*!
- * \breif Hand's contour is the largest one. 
+ * \brief Morphology structuring element (3x3 ellipse), created once.
  *
- *  During the contour extraction in the binary hand image can happens
- *  that more contours are detected because of noise, hand contour is
- *  the largest one.
+ * The anchor is the center pixel, so opening and closing do not shift
+ * the mask and match the centered cross of bitmask_smooth.
  *
- * \param[in]  Sequence of contours
- * \return     hand's contour 
+ * \param[in]  pipeline context
+ * \return     structuring element
  */
-static CvSeq *get_largest_contour (CvSeq* contours)
+static IplConvKernel *get_strel (xkin_ctx *ctx)
 {
-	CvSeq *tmp, *larger=contours;
-        float max=0;
-
-        for (tmp=contours; tmp!=NULL; tmp=tmp->h_next) {
-                double len = cvContourPerimeter(tmp);
+	xkin_hand *s = &(ctx->hand);
 
-                if (len > max) {
-                        max = len;
-                        larger = tmp;
-                }
-        }
+	if (s->strel==NULL) {
+		s->strel = cvCreateStructuringElementEx(3, 3, 1, 1,
+							CV_SHAPE_ELLIPSE, NULL);
+		ctx->allocs++;
+	}
 
-        return larger;
+	return s->strel;
 }
 
 /*!
- * \brief Calculate le centroid of the contour.
+ * \brief Centroid of the hand blob.
  *
- * \param[in]  contour
+ * The centroid is the first order moments over the area, steadier than
+ * the mean of the contour points.
+ *
+ * \param[in]  hand state (blob of the last contour extraction)
+ * \param[in]  offset of the image the blob was found in
  * \retrun     centroid point 
  */
-static CvPoint get_contour_centroid (CvSeq* contour)
+static CvPoint get_blob_centroid (xkin_hand *s, CvPoint off)
 {
-	float x=0, y=0;
-	int i, tot=contour->total;
-
-	for (i=0; i<tot; i++) {
-		CvPoint *p = (CvPoint*)cvGetSeqElem(contour, i);
-
-		x += p->x;
-		y += p->y;
-	}
-	x /= tot;
-	y /= tot;
-
-	return cvPoint((int)x, (int)y);
+	return cvPoint((int)(s->blob.centroid.x + off.x),
+		       (int)(s->blob.centroid.y + off.y));
 }
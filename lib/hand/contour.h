@@ -3,6 +3,10 @@
 
 int       get_hand_contour_basic         (IplImage*, CvSeq**, CvPoint*);
 int       get_hand_contour_advanced      (IplImage*, IplImage*, int, CvSeq**, CvPoint*);
+int       get_hand_contour_basic_ctx     (xkin_ctx*, IplImage*, CvRect*,
+					  xkin_contour**, CvPoint*);
+int       get_hand_contour_advanced_ctx  (xkin_ctx*, IplImage*, IplImage*, int,
+					  CvRect*, xkin_contour**, CvPoint*);
 
 
 #endif /* _CONTOUR_H_ */
@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file filter.c
+ * \author Fabrizio Pedersoli
+ *
+ * 7x7 filters for 8 bit single channel images, used on the color hand
+ * ROI in place of cvSmooth.
+ *
+ * The Gaussian is separable with the kernel opencv uses for size 7
+ * (1 3.5 7 9 7 3.5 1)/32, taken as (2 7 14 18 14 7 2)/64 in fixed
+ * point, borders reflected as opencv (BORDER_REFLECT_101).
+ *
+ * The median is the constant time one of [0]: a 256 bin histogram
+ * per column is updated with one pixel in and one out per row, the
+ * kernel histogram slides along the row adding and removing column
+ * histograms. Histograms are two level, 16 coarse bins always kept up
+ * to date and 16 fine bins per coarse bin, updated only when the
+ * median falls in that coarse bin. Borders are replicated as opencv.
+ *
+ * [0] S. Perreault, P. Hebert, "Median filtering in constant time",
+ *     IEEE Trans. Image Processing, 16(9), 2007.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <opencv2/core/core_c.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libxkin.h"
+#include "filter.h"
+
+#define R 3              //!< kernel radius
+#define RANK (R*(2*R+2)) //!< median rank in the (2R+1)^2 window
+
+
+static int         reflect101     (int, int);
+static int         replicate      (int, int);
+static void        gauss_row      (const unsigned char*, uint16_t*, int);
+static void        gauss_col      (uint16_t**, unsigned char*, int);
+static void        hist_update    (uint16_t*, const uint16_t*,
+				   const uint16_t*);
+
+
+/*!
+ * \brief 7x7 Gaussian filter.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   source image (8 bit, 1 channel)
+ * \param[out]  filtered image (can be the source)
+ */
+void filter_gaussian7 (xkin_ctx *ctx, IplImage *src, IplImage *dst)
+{
+	int w = src->width, h = src->height, y, x;
+	unsigned char *pad;
+	uint16_t *hrow;
+
+	pad = (unsigned char*)xkin_alloc(ctx, w + 2*R);
+	hrow = (uint16_t*)xkin_alloc(ctx, sizeof(uint16_t) * w * h);
+
+	/* horizontal pass on the whole image, then vertical */
+	for (y=0; y<h; y++) {
+		unsigned char *p = (unsigned char*)src->imageData +
+			y*src->widthStep;
+
+		for (x=-R; x<w+R; x++)
+			pad[x+R] = p[reflect101(x, w)];
+
+		gauss_row(pad, hrow + y*w, w);
+	}
+
+	for (y=0; y<h; y++) {
+		uint16_t *rows[2*R+1];
+		int k;
+
+		for (k=-R; k<=R; k++)
+			rows[k+R] = hrow + reflect101(y+k, h)*w;
+
+		gauss_col(rows, (unsigned char*)dst->imageData +
+			  y*dst->widthStep, w);
+	}
+}
+
+/*!
+ * \brief 7x7 median filter.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   source image (8 bit, 1 channel)
+ * \param[out]  filtered image (can be the source)
+ */
+void filter_median7 (xkin_ctx *ctx, IplImage *src, IplImage *dst)
+{
+	int w = src->width, h = src->height, x, y, k;
+	uint16_t *colc, *colf, hc[16], hf[16*16];
+	int last[16];
+
+	if (src == dst) {
+		src = xkin_alloc_image(ctx, cvSize(w, h), 8, 1);
+		cvCopy(dst, src, NULL);
+	}
+
+	colc = (uint16_t*)xkin_alloc(ctx, sizeof(uint16_t) * 16 * w);
+	colf = (uint16_t*)xkin_alloc(ctx, sizeof(uint16_t) * 256 * w);
+	memset(colc, 0, sizeof(uint16_t) * 16 * w);
+	memset(colf, 0, sizeof(uint16_t) * 256 * w);
+
+	for (k=-R; k<=R; k++) {
+		unsigned char *p = (unsigned char*)src->imageData +
+			replicate(k, h)*src->widthStep;
+
+		for (x=0; x<w; x++) {
+			colc[16*x + (p[x]>>4)]++;
+			colf[256*x + p[x]]++;
+		}
+	}
+
+	for (y=0; y<h; y++) {
+		unsigned char *out = (unsigned char*)dst->imageData +
+			y*dst->widthStep;
+
+		if (y > 0) {
+			unsigned char *a = (unsigned char*)src->imageData +
+				replicate(y+R, h)*src->widthStep;
+			unsigned char *b = (unsigned char*)src->imageData +
+				replicate(y-R-1, h)*src->widthStep;
+
+			for (x=0; x<w; x++) {
+				colc[16*x + (a[x]>>4)]++;
+				colf[256*x + a[x]]++;
+				colc[16*x + (b[x]>>4)]--;
+				colf[256*x + b[x]]--;
+			}
+		}
+
+		memset(hc, 0, sizeof(hc));
+		for (k=-R; k<=R; k++)
+			hist_update(hc, colc + 16*replicate(k, w), NULL);
+		for (k=0; k<16; k++)
+			last[k] = -2*R-2;
+
+		for (x=0; x<w; x++) {
+			int b, i, sum=0;
+
+			if (x > 0)
+				hist_update(hc, colc + 16*replicate(x+R, w),
+					    colc + 16*replicate(x-R-1, w));
+
+			for (b=0; sum + hc[b] <= RANK; b++)
+				sum += hc[b];
+
+			if (x - last[b] > 2*R+1) {
+				memset(hf + 16*b, 0, sizeof(uint16_t) * 16);
+				for (k=x-R; k<=x+R; k++)
+					hist_update(hf + 16*b,
+						    colf + 256*replicate(k, w) + 16*b,
+						    NULL);
+			} else {
+				for (k=last[b]+1; k<=x; k++)
+					hist_update(hf + 16*b,
+						    colf + 256*replicate(k+R, w) + 16*b,
+						    colf + 256*replicate(k-R-1, w) + 16*b);
+			}
+			last[b] = x;
+
+			for (i=0; sum + hf[16*b+i] <= RANK; i++)
+				sum += hf[16*b+i];
+
+			out[x] = 16*b + i;
+		}
+	}
+}
+
+/*!
+ * \brief Index of a reflected border (BORDER_REFLECT_101).
+ *
+ * \param[in]  index
+ * \param[in]  length
+ * \return     index in [0,n)
+ */
+static int reflect101 (int i, int n)
+{
+	if (n == 1)
+		return 0;
+
+	while (i < 0 || i >= n)
+		i = i < 0 ? -i : 2*(n-1) - i;
+
+	return i;
+}
+
+/*!
+ * \brief Index of a replicated border.
+ *
+ * \param[in]  index
+ * \param[in]  length
+ * \return     index in [0,n)
+ */
+static int replicate (int i, int n)
+{
+	return i < 0 ? 0 : (i >= n ? n-1 : i);
+}
+
+/*!
+ * \brief Horizontal Gaussian of a row (x64).
+ *
+ * \param[in]   row with R border pixels on each side
+ * \param[out]  filtered row
+ * \param[in]   row length
+ */
+static void gauss_row (const unsigned char *p, uint16_t *dst, int n)
+{
+	int x=0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i k0 = _mm_set1_epi16(2), k1 = _mm_set1_epi16(7);
+	const __m128i k2 = _mm_set1_epi16(14), k3 = _mm_set1_epi16(18);
+
+	/* the last load ends at p[x+2R+7], inside the n+2R row */
+	for (; x+8<=n; x+=8) {
+		__m128i a[2*R+1], s;
+		int k;
+
+		for (k=0; k<=2*R; k++)
+			a[k] = _mm_unpacklo_epi8(_mm_loadl_epi64(
+				(const __m128i*)(p+x+k)), zero);
+
+		s = _mm_mullo_epi16(_mm_add_epi16(a[0], a[6]), k0);
+		s = _mm_add_epi16(s, _mm_mullo_epi16(_mm_add_epi16(a[1], a[5]), k1));
+		s = _mm_add_epi16(s, _mm_mullo_epi16(_mm_add_epi16(a[2], a[4]), k2));
+		s = _mm_add_epi16(s, _mm_mullo_epi16(a[3], k3));
+		_mm_storeu_si128((__m128i*)(dst+x), s);
+	}
+#endif
+	for (; x<n; x++) {
+		dst[x] = 2*(p[x] + p[x+6]) + 7*(p[x+1] + p[x+5]) +
+			14*(p[x+2] + p[x+4]) + 18*p[x+3];
+	}
+}
+
+/*!
+ * \brief Vertical Gaussian of horizontally filtered rows, rounded to
+ * 8 bit.
+ *
+ * \param[in]   the 2R+1 rows of the window
+ * \param[out]  output row
+ * \param[in]   row length
+ */
+static void gauss_col (uint16_t **r, unsigned char *dst, int n)
+{
+	int x=0;
+
+#if defined(__SSE2__)
+	/* symmetric pairs are below 2^15: signed multiply-add is safe */
+	const __m128i k01 = _mm_set1_epi32(2 | 7<<16);
+	const __m128i k23 = _mm_set1_epi32(14 | 18<<16);
+	const __m128i half = _mm_set1_epi32(1<<11);
+
+	for (; x+8<=n; x+=8) {
+		__m128i s06, s15, s24, s3, lo, hi;
+
+		s06 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r[0]+x)),
+				    _mm_loadu_si128((const __m128i*)(r[6]+x)));
+		s15 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r[1]+x)),
+				    _mm_loadu_si128((const __m128i*)(r[5]+x)));
+		s24 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(r[2]+x)),
+				    _mm_loadu_si128((const __m128i*)(r[4]+x)));
+		s3 = _mm_loadu_si128((const __m128i*)(r[3]+x));
+
+		lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(s06, s15), k01),
+				   _mm_madd_epi16(_mm_unpacklo_epi16(s24, s3), k23));
+		hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(s06, s15), k01),
+				   _mm_madd_epi16(_mm_unpackhi_epi16(s24, s3), k23));
+		lo = _mm_srai_epi32(_mm_add_epi32(lo, half), 12);
+		hi = _mm_srai_epi32(_mm_add_epi32(hi, half), 12);
+		lo = _mm_packs_epi32(lo, hi);
+		_mm_storel_epi64((__m128i*)(dst+x), _mm_packus_epi16(lo, lo));
+	}
+#endif
+	for (; x<n; x++) {
+		int s = 2*(r[0][x] + r[6][x]) + 7*(r[1][x] + r[5][x]) +
+			14*(r[2][x] + r[4][x]) + 18*r[3][x];
+
+		dst[x] = (s + (1<<11)) >> 12;
+	}
+}
+
+/*!
+ * \brief Add a 16 bin histogram and subtract another.
+ *
+ * \param[in,out]  histogram
+ * \param[in]      histogram to add
+ * \param[in]      histogram to subtract (can be NULL)
+ */
+static void hist_update (uint16_t *h, const uint16_t *a, const uint16_t *s)
+{
+#if defined(__SSE2__)
+	__m128i h0 = _mm_loadu_si128((const __m128i*)h);
+	__m128i h1 = _mm_loadu_si128((const __m128i*)(h+8));
+
+	h0 = _mm_add_epi16(h0, _mm_loadu_si128((const __m128i*)a));
+	h1 = _mm_add_epi16(h1, _mm_loadu_si128((const __m128i*)(a+8)));
+	if (s != NULL) {
+		h0 = _mm_sub_epi16(h0, _mm_loadu_si128((const __m128i*)s));
+		h1 = _mm_sub_epi16(h1, _mm_loadu_si128((const __m128i*)(s+8)));
+	}
+	_mm_storeu_si128((__m128i*)h, h0);
+	_mm_storeu_si128((__m128i*)(h+8), h1);
+#else
+	int i;
+
+	for (i=0; i<16; i++)
+		h[i] += a[i] - (s != NULL ? s[i] : 0);
+#endif
+}
@@ -0,0 +1,7 @@
+#ifndef _FILTER_H_
+#define _FILTER_H_
+
+void       filter_gaussian7    (xkin_ctx*, IplImage*, IplImage*);
+void       filter_median7      (xkin_ctx*, IplImage*, IplImage*);
+
+#endif /* _FILTER_H_ */
@@ -38,26 +38,42 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <limits.h>
 #include <opencv2/core/core_c.h>
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
 
+#include "libxkin.h"
 #include "const.h"
 #include "contour.h"
 #include "clustering.h"	
+#include "transform.h"
+#include "bitmask.h"
 #include "visualiz.h"
 #include "hand.h"
 
 
-static void      get_hand_image         (IplImage*, IplImage*, int*);
+static void      get_hand_image         (IplImage*, IplImage*, CvRect, int*);
+static void      get_hand_image_native  (IplImage*, IplImage*, CvRect, int*,
+					 xkin_moments*);
 static int       eval_hand_depth        (int*);
+static void      make_hand_mask         (xkin_ctx*, IplImage*, CvRect, int*);
+static int       track_window           (xkin_ctx*, IplImage*, CvRect, CvRect*,
+					 int*);
+static int       track_update           (xkin_ctx*, IplImage*, CvRect, CvRect,
+					 int*, int);
+static void      image_moments          (IplImage*, CvRect, xkin_moments*);
+static int       min_depth              (IplImage*, CvRect);
 
 
 /*!
  * \brief Detect the hand straring from the body depth image.
  *
  * the function produces a binary image that contoins only the shpade
- * of the hand starting from the bodpy depth image. 
+ * of the hand starting from the bodpy depth image. This uses the
+ * default (process wide) context, see hand_detection_ctx.
  *
  * \param[in]    depth body image
  * \param[out]   mean depth value of the hand
@@ -65,22 +81,313 @@ static int       eval_hand_depth        (int*);
  */
 IplImage* hand_detection (IplImage *body, int *z)
 {
-	int thrs[2], valid;
-	CvSeq *ctr, *prev=NULL, *curr;
-	static IplImage *hand=NULL;
-	
-	if (hand == NULL) 
-		hand = cvCreateImage(cvGetSize(body), 8, 1);
-	else 
-		cvZero(hand);
-
-	get_hand_interval(body, thrs);
-	//get_hand_interval_2(body, thrs);
-	get_hand_image(body, hand, thrs);
-
-	*z = eval_hand_depth(thrs);
+	return hand_detection_ctx(xkin_default_ctx(), body, NULL, z);
+}
+
+/*!
+ * \brief Detect the hand starting from the body depth image using a
+ * pipeline context.
+ *
+ * The body image can be 8 bit or 16 bit (XKIN_DEPTH_NATIVE mode), in
+ * the latter case the hand depth is returned in millimetres. The hand
+ * image is always 8 bit binary.
+ *
+ * When the body bounding box is given (ctx->body.roi) only that region
+ * of the body image is processed.
+ *
+ * The hand depth interval is found by clustering the body depth
+ * values, ctx->hand.clustering selects the method (XKIN_CLUSTER_*).
+ *
+ * With ctx->hand.morphology set to XKIN_MORPH_PACKED (default) the
+ * band test builds a bit packed mask, kept in the context for the
+ * contour smoothing, and the hand image is written from it.
+ *
+ * With ctx->hand.track_period > 0 the hand box and depth interval are
+ * tracked: the next box is predicted (xkin_hand_track) and the hand
+ * is searched only in a window around it, the depth interval follows
+ * the nearest depth of the window. When the result does not match
+ * the track (no hand, area change, hand reaching the window border)
+ * or every track_period frames the full region is processed.
+ * ctx->hand.roi is the region actually written.
+ *
+ * This is the first function of the hand stage, it starts a new frame
+ * of the context (see xkin_ctx_frame).
+ *
+ * \param[in]    pipeline context
+ * \param[in]    depth body image
+ * \param[in]    body bounding box (NULL for the whole image)
+ * \param[out]   mean depth value of the hand
+ * \return       binary hand image (owned by the context)
+ */
+IplImage* hand_detection_ctx (xkin_ctx *ctx, IplImage *body, CvRect *roi,
+			      int *z)
+{
+	xkin_hand *s = &(ctx->hand);
+	CvRect r, full = clip_roi(roi, cvGetSize(body), ROI_MARGIN);
+	int thrs[2], tracked = 0;
+
+	xkin_ctx_frame(ctx);
+
+	if (s->hand == NULL) {
+		xkin_image(ctx, &(s->hand), cvGetSize(body), 8, 1);
+		cvZero(s->hand);
+	} else if (s->roi.width > 0 && s->roi.height > 0) {
+		cvSetImageROI(s->hand, s->roi);
+		cvZero(s->hand);
+		cvResetImageROI(s->hand);
+	}
+
+	if (track_window(ctx, body, full, &r, thrs)) {
+		make_hand_mask(ctx, body, r, thrs);
+		if ((tracked = track_update(ctx, body, r, full, thrs, 1)))
+			s->track.hits++;
+		else
+			s->track.misses++;
+	}
+
+	/* the full region covers the window, no need to clear it */
+	if (!tracked) {
+		r = full;
+		get_hand_interval(body, r, s->clustering, thrs);
+		//get_hand_interval_2(body, thrs);
+		make_hand_mask(ctx, body, r, thrs);
+		track_update(ctx, body, r, full, thrs, 0);
+	}
+	s->roi = r;
+
+	if (body->depth == IPL_DEPTH_16U)
+		*z = depth_raw_to_mm(eval_hand_depth(thrs));
+	else
+		*z = eval_hand_depth(thrs);
        
-	return hand;
+	return s->hand;
+}
+
+/*!
+ * \brief Write the hand image (and the packed mask) of a region.
+ *
+ * The moments of the hand image region are computed while it is
+ * built, except for the 8 bit opencv thresholds.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  depth body image
+ * \param[in]  region
+ * \param[in]  hand's depth interval
+ */
+static void make_hand_mask (xkin_ctx *ctx, IplImage *body, CvRect r,
+			    int *thrs)
+{
+	xkin_hand *s = &(ctx->hand);
+
+	s->mask_valid = 0;
+	if (s->morphology == XKIN_MORPH_PACKED) {
+		int max = thrs[1] + (body->depth == IPL_DEPTH_16U ?
+				     HAND_MARGIN_NATIVE : HAND_MARGIN);
+
+		bitmask_from_depth(ctx, &(s->mask), body, r, max,
+				   &(s->moments));
+		bitmask_to_image(&(s->mask), s->hand, r);
+		s->mask_valid = 1;
+	} else if (body->depth == IPL_DEPTH_16U) {
+		get_hand_image_native(body, s->hand, r, thrs, &(s->moments));
+	} else {
+		get_hand_image(body, s->hand, r, thrs);
+		image_moments(s->hand, r, &(s->moments));
+	}
+}
+
+/*!
+ * \brief Predict the hand window and depth interval.
+ *
+ * The window is the predicted box enlarged by TRACK_HAND_SCALE, by
+ * the displacement and by a margin. The interval is the tracked one
+ * moved as the nearest depth in the window.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   depth body image
+ * \param[in]   full region
+ * \param[out]  window
+ * \param[out]  hand's depth interval
+ * \return      1 if the prediction can be used, 0 for a full detection
+ */
+static int track_window (xkin_ctx *ctx, IplImage *body, CvRect full,
+			 CvRect *win, int *thrs)
+{
+	xkin_hand *s = &(ctx->hand);
+	xkin_hand_track *t = &(s->track);
+	float cx, cy, hw, hh;
+	int x0, y0, x1, y1, dmin;
+
+	if (s->track_period <= 0 || !t->valid || t->age >= s->track_period)
+		return 0;
+
+	cx = t->x + t->vx;
+	cy = t->y + t->vy;
+	hw = t->w * TRACK_HAND_SCALE / 2 + fabsf(t->vx) + TRACK_HAND_MARGIN;
+	hh = t->h * TRACK_HAND_SCALE / 2 + fabsf(t->vy) + TRACK_HAND_MARGIN;
+
+	x0 = (int)(cx - hw) < full.x ? full.x : (int)(cx - hw);
+	y0 = (int)(cy - hh) < full.y ? full.y : (int)(cy - hh);
+	x1 = (int)(cx + hw) > full.x + full.width ?
+		full.x + full.width : (int)(cx + hw);
+	y1 = (int)(cy + hh) > full.y + full.height ?
+		full.y + full.height : (int)(cy + hh);
+
+	if (x1 <= x0 || y1 <= y0)
+		return 0;
+
+	*win = cvRect(x0, y0, x1-x0, y1-y0);
+
+	if ((dmin = min_depth(body, *win)) == 0)
+		return 0;
+
+	thrs[0] = t->thrs[0] + dmin - t->dmin;
+	thrs[1] = t->thrs[1] + dmin - t->dmin;
+
+	return 1;
+}
+
+/*!
+ * \brief Update the track with the hand mask of the frame (its
+ * moments).
+ *
+ * A mask found in the predicted window is rejected when empty, when
+ * its area changed by more than TRACK_HAND_RATIO, or when it reaches
+ * a window side that is not a side of the full region (the hand goes
+ * on outside the window). A full detection always restarts the track
+ * age, and the velocity too if the track was lost.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  depth body image
+ * \param[in]  region of the mask
+ * \param[in]  full region
+ * \param[in]  hand's depth interval
+ * \param[in]  the region is the predicted window
+ * \return     1 if the mask has been accepted
+ */
+static int track_update (xkin_ctx *ctx, IplImage *body, CvRect r,
+			 CvRect full, int *thrs, int tracked)
+{
+	xkin_hand *s = &(ctx->hand);
+	xkin_hand_track *t = &(s->track);
+	CvRect bb = s->moments.bbox;
+	int area = (int)s->moments.m00;
+	float cx, cy;
+
+	if (area == 0) {
+		t->valid = 0;
+		return 0;
+	}
+
+	if (tracked && (area < t->area * TRACK_HAND_RATIO ||
+			area * TRACK_HAND_RATIO > t->area ||
+			(bb.x == r.x && r.x > full.x) ||
+			(bb.y == r.y && r.y > full.y) ||
+			(bb.x + bb.width == r.x + r.width &&
+			 r.x + r.width < full.x + full.width) ||
+			(bb.y + bb.height == r.y + r.height &&
+			 r.y + r.height < full.y + full.height))) {
+		t->valid = 0;
+		return 0;
+	}
+
+	cx = bb.x + bb.width / 2.f;
+	cy = bb.y + bb.height / 2.f;
+
+	if (t->valid) {
+		float px = t->x + t->vx, py = t->y + t->vy;
+
+		t->x = px + TRACK_ALPHA * (cx - px);
+		t->y = py + TRACK_ALPHA * (cy - py);
+		t->vx += TRACK_BETA * (cx - px);
+		t->vy += TRACK_BETA * (cy - py);
+	} else {
+		t->x = cx;
+		t->y = cy;
+		t->vx = t->vy = 0;
+	}
+
+	t->w = bb.width;
+	t->h = bb.height;
+	t->area = area;
+	t->thrs[0] = thrs[0];
+	t->thrs[1] = thrs[1];
+	t->dmin = min_depth(body, bb);
+	t->age = tracked ? t->age + 1 : 0;
+	t->valid = t->dmin > 0;
+
+	return 1;
+}
+
+/*!
+ * \brief Moments of the hand image in a region.
+ *
+ * \param[in]   binary hand image
+ * \param[in]   region
+ * \param[out]  moments
+ */
+static void image_moments (IplImage *hand, CvRect r, xkin_moments *mo)
+{
+	int i, j, x0=INT_MAX, x1=-1, y0=-1, y1=-1;
+
+	mo->m00 = mo->m10 = mo->m01 = 0;
+
+	for (i=r.y; i<r.y+r.height; i++) {
+		uint8_t *p = (uint8_t*)(hand->imageData + i*hand->widthStep);
+		int n=0, sx=0;
+
+		for (j=r.x; j<r.x+r.width; j++) {
+			if (p[j] == 0)
+				continue;
+			n++;
+			sx += j;
+			x0 = j < x0 ? j : x0;
+			x1 = j > x1 ? j : x1;
+		}
+		if (n == 0)
+			continue;
+
+		mo->m00 += n;
+		mo->m10 += sx;
+		mo->m01 += (double)i * n;
+		y0 = y0 < 0 ? i : y0;
+		y1 = i;
+	}
+
+	mo->bbox = x1 < 0 ? cvRect(0, 0, 0, 0) :
+		cvRect(x0, y0, x1-x0+1, y1-y0+1);
+}
+
+/*!
+ * \brief Nearest (smallest non zero) depth in a region.
+ *
+ * \param[in]  depth body image (8 or 16 bit)
+ * \param[in]  region
+ * \return     depth, 0 if the region is empty
+ */
+static int min_depth (IplImage *body, CvRect r)
+{
+	int i, j, min = 0xffff;
+
+	for (i=r.y; i<r.y+r.height; i++) {
+		char *row = body->imageData + i*body->widthStep;
+
+		if (body->depth == IPL_DEPTH_16U) {
+			uint16_t *p = (uint16_t*)row;
+
+			for (j=r.x; j<r.x+r.width; j++)
+				if (p[j] != 0 && p[j] < min)
+					min = p[j];
+		} else {
+			uint8_t *p = (uint8_t*)row;
+
+			for (j=r.x; j<r.x+r.width; j++)
+				if (p[j] != 0 && p[j] < min)
+					min = p[j];
+		}
+	}
+
+	return min == 0xffff ? 0 : min;
 }
 
 /*!
@@ -107,13 +414,69 @@ static int eval_hand_depth (int *thrs)
  *
  * \param[in]   body depth image
  * \param[out}  binary hand image
+ * \param[in]   region of interest
  * \param[in]   depth intarvals 
  */
-static void get_hand_image (IplImage *body, IplImage *hand, int *thrs)
+static void get_hand_image (IplImage *body, IplImage *hand, CvRect roi,
+			    int *thrs)
 {
+	cvSetImageROI(body, roi);
+	cvSetImageROI(hand, roi);
 	cvThreshold(body, hand, thrs[0], 0, CV_THRESH_TOZERO);
-	cvThreshold(body, hand, thrs[1]+2, 0, CV_THRESH_TOZERO_INV);
+	cvThreshold(body, hand, thrs[1]+HAND_MARGIN, 0, CV_THRESH_TOZERO_INV);
 	cvThreshold(hand, hand, 0, 255, CV_THRESH_BINARY);
+	cvResetImageROI(body);
+	cvResetImageROI(hand);
+}
+
+/*!
+ * \brief Make a binary image from the native (16 bit) body image.
+ *
+ * Same as get_hand_image, done in a single pass since the body is not
+ * 8 bit. The moments are accumulated in the same pass.
+ *
+ * \param[in]   body depth image (16 bit)
+ * \param[out}  binary hand image
+ * \param[in]   region of interest
+ * \param[in]   depth intarvals 
+ * \param[out]  moments of the hand image
+ */
+static void get_hand_image_native (IplImage *body, IplImage *hand, CvRect roi,
+				   int *thrs, xkin_moments *mo)
+{
+	int i, j, max = thrs[1] + HAND_MARGIN_NATIVE;
+	int x0=INT_MAX, x1=-1, y0=-1, y1=-1;
+
+	mo->m00 = mo->m10 = mo->m01 = 0;
+
+	for (i=roi.y; i<roi.y+roi.height; i++) {
+		uint16_t *src = (uint16_t*)(body->imageData + i*body->widthStep);
+		uint8_t *dst = (uint8_t*)(hand->imageData + i*hand->widthStep);
+		int n=0, sx=0;
+
+		for (j=roi.x; j<roi.x+roi.width; j++) {
+			int b = src[j] != 0 && src[j] <= max;
+
+			dst[j] = b ? 255 : 0;
+			if (b) {
+				n++;
+				sx += j;
+				x0 = j < x0 ? j : x0;
+				x1 = j > x1 ? j : x1;
+			}
+		}
+		if (n == 0)
+			continue;
+
+		mo->m00 += n;
+		mo->m10 += sx;
+		mo->m01 += (double)i * n;
+		y0 = y0 < 0 ? i : y0;
+		y1 = i;
+	}
+
+	mo->bbox = x1 < 0 ? cvRect(0, 0, 0, 0) :
+		cvRect(x0, y0, x1-x0+1, y1-y0+1);
 }
 
 
@@ -2,6 +2,7 @@
 #define _HAND_H_
 
 IplImage*          hand_detection         (IplImage*,int*);
+IplImage*          hand_detection_ctx     (xkin_ctx*,IplImage*,CvRect*,int*);
 
 
 #endif /* _HAND_H_ */
@@ -0,0 +1,523 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file registration.c
+ * \author Fabrizio Pedersoli
+ *
+ * Depth to color registration. A depth pixel (u,v) at depth z is
+ * back projected with the depth camera intrinsics, moved in the color
+ * camera frame (R, T) and projected with the color intrinsics [0].
+ *
+ * For a given z every step is linear in u and v except the final
+ * division, so the two numerators and the denominator split in a
+ * per column and a per row term. The terms are tabulated for the few
+ * depths in use (one per frame, the hand depth), a point then costs
+ * six lookups, three additions and the division. Masks are mapped
+ * computing exact points every REG_STEP columns and interpolating in
+ * fixed point between them.
+ *
+ * [0] http://nicolas.burrus.name/index.php/Research/KinectCalibration
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+#include "const.h"
+#include "registration.h"
+
+#define LUT_W (WIDTH+1)
+#define LUT_H (HEIGHT+1)
+#define LUT_SIZE (3*(LUT_W+LUT_H))
+
+static const double depth_intr[4] = { 5.9421434211923247e+02,
+				      5.9104053696870778e+02,
+				      3.3930780975300314e+02,
+				      2.4273913761751615e+02 };
+
+static const double rgb_intr[4] = { 5.2921508098293293e+02,
+				    5.2556393630057437e+02,
+				    3.2894272028759258e+02,
+				    2.6748068171871557e+02 };
+
+static const double T_def[3] = { 1.9985242312092553e-02,
+				 -7.4423738761617583e-04,
+				 -1.0916736334336222e-02 };
+
+static const double R_def[9] = { 9.9984628826577793e-01,
+				 1.2635359098409581e-03,
+				 -1.7487233004436643e-02,
+				 -1.4779096108364480e-03,
+				 9.9992385683542895e-01,
+				 -1.2251380107679535e-02,
+				 1.7470421412464927e-02,
+				 1.2275341476520762e-02,
+				 9.9977202419716948e-01 };
+
+
+static xkin_registration* get_registration   (xkin_ctx*);
+static double*            get_table          (xkin_ctx*, int);
+static void               fill_table         (xkin_registration*, double*, int);
+static CvPoint            map_point_exact    (xkin_registration*, CvPoint, int);
+static int                read_intrinsics    (CvFileStorage*, const char*, double*);
+static int                read_matrix        (CvFileStorage*, const char*, double*, int);
+
+
+/*!
+ * \brief Load the calibration of the kinect cameras.
+ *
+ * \param[in]  calibration file (opencv yml/xml)
+ * \return     1 if loaded, 0 otherwise
+ */
+int hand_registration_load (const char *file)
+{
+	return hand_registration_load_ctx(xkin_default_ctx(), file);
+}
+
+/*!
+ * \brief Load the calibration of the kinect cameras in a pipeline
+ * context.
+ *
+ * The file is the one produced by the kinect calibration tool of
+ * [0]: rgb_intrinsics and depth_intrinsics (3x3), R (3x3) and T (3
+ * elements, metres). On failure the calibration in use is not
+ * changed.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  calibration file (opencv yml/xml)
+ * \return     1 if loaded, 0 otherwise
+ */
+int hand_registration_load_ctx (xkin_ctx *ctx, const char *file)
+{
+	xkin_registration *s = &(ctx->hand.reg);
+	double depth[4], rgb[4], R[9], T[3];
+	CvFileStorage *fs;
+	int i, ok;
+
+	if ((fs = cvOpenFileStorage(file, NULL, CV_STORAGE_READ, NULL)) == NULL)
+		return 0;
+
+	ok = read_intrinsics(fs, "depth_intrinsics", depth) &&
+		read_intrinsics(fs, "rgb_intrinsics", rgb) &&
+		read_matrix(fs, "R", R, 9) &&
+		read_matrix(fs, "T", T, 3);
+
+	cvReleaseFileStorage(&fs);
+
+	if (!ok)
+		return 0;
+
+	memcpy(s->depth, depth, sizeof(depth));
+	memcpy(s->rgb, rgb, sizeof(rgb));
+	memcpy(s->R, R, sizeof(R));
+	memcpy(s->T, T, sizeof(T));
+	s->loaded = 1;
+
+	for (i=0; i<XKIN_REG_TABLES; i++)
+		s->z[i] = -1;
+
+	return 1;
+}
+
+/*!
+ * \brief Map a contour from depth to color.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   contour in the depth image
+ * \param[in]   depth (mm)
+ * \param[out]  contour in the color image
+ */
+void hand_map_contour_ctx (xkin_ctx *ctx, xkin_contour *src, int z,
+			   xkin_contour *dst)
+{
+	xkin_registration *s = get_registration(ctx);
+	double *xu, *yu, *wu, *xv, *yv, *wv;
+	int i;
+
+	xu = get_table(ctx, z);
+	yu = xu + LUT_W;
+	wu = yu + LUT_W;
+	xv = wu + LUT_W;
+	yv = xv + LUT_H;
+	wv = yv + LUT_H;
+
+	ctx->allocs += xkin_contour_reserve(dst, src->num);
+
+	for (i=0; i<src->num; i++) {
+		int u = src->x[i], v = src->y[i];
+
+		if (u < 0 || u >= LUT_W || v < 0 || v >= LUT_H) {
+			CvPoint p = map_point_exact(s, cvPoint(u, v), z);
+
+			dst->x[i] = p.x;
+			dst->y[i] = p.y;
+		} else {
+			double w = wu[u] + wv[v];
+
+			dst->x[i] = (int)((xu[u] + xv[v]) / w);
+			dst->y[i] = (int)((yu[u] + yv[v]) / w);
+		}
+	}
+	dst->num = src->num;
+}
+
+/*!
+ * \brief Map a binary mask from depth to color.
+ *
+ * Every non zero pixel of the mask (in the region) is set to 255 in
+ * the color space image, which is not cleared.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   binary mask in the depth image
+ * \param[in]   region of the mask to map (NULL for the whole image)
+ * \param[in]   depth (mm)
+ * \param[out]  mask in the color image
+ * \return      number of pixels written
+ */
+int hand_map_mask_ctx (xkin_ctx *ctx, IplImage *mask, CvRect *roi, int z,
+		       IplImage *dst)
+{
+	CvRect r = roi != NULL ? *roi : cvRect(0, 0, mask->width, mask->height);
+
+	return registration_map_mask(ctx, mask, r, z, dst, cvPoint(0, 0));
+}
+
+/*!
+ * \brief Map a point from depth to color.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  depth point
+ * \param[in]  depth (mm)
+ * \return     color point
+ */
+CvPoint registration_map_point (xkin_ctx *ctx, CvPoint p, int z)
+{
+	double *xu, *yu, *wu, *xv, *yv, *wv, w;
+
+	if (p.x < 0 || p.x >= LUT_W || p.y < 0 || p.y >= LUT_H)
+		return map_point_exact(get_registration(ctx), p, z);
+
+	xu = get_table(ctx, z);
+	yu = xu + LUT_W;
+	wu = yu + LUT_W;
+	xv = wu + LUT_W;
+	yv = xv + LUT_H;
+	wv = yv + LUT_H;
+
+	w = wu[p.x] + wv[p.y];
+
+	return cvPoint((int)((xu[p.x] + xv[p.y]) / w),
+		       (int)((yu[p.x] + yv[p.y]) / w));
+}
+
+/*!
+ * \brief Map a bounding box from depth to color.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  bounding box in depth
+ * \param[in]  depth (mm)
+ * \return     bounding box in color
+ */
+CvRect registration_map_rect (xkin_ctx *ctx, CvRect r, int z)
+{
+	CvPoint tl, tr, bl;
+
+	tl = registration_map_point(ctx, cvPoint(r.x, r.y), z);
+	tr = registration_map_point(ctx, cvPoint(r.x + r.width, r.y), z);
+	bl = registration_map_point(ctx, cvPoint(r.x, r.y + r.height), z);
+
+	return cvRect(tl.x, tl.y, abs(tl.x - tr.x), abs(tl.y - bl.y));
+}
+
+/*!
+ * \brief Map a binary mask from depth to color, writing the region
+ * of the color image that starts at an offset.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   binary mask in the depth image
+ * \param[in]   region of the mask to map
+ * \param[in]   depth (mm)
+ * \param[out]  mask in the color image (region at off)
+ * \param[in]   color coordinates of the dst origin
+ * \return      number of pixels written
+ */
+int registration_map_mask (xkin_ctx *ctx, IplImage *mask, CvRect roi, int z,
+			   IplImage *dst, CvPoint off)
+{
+	double *xu, *yu, *wu, *xv, *yv, *wv;
+	int u, v, x1, y1, count=0;
+
+	if (z <= 0)
+		return 0;
+
+	xu = get_table(ctx, z);
+	yu = xu + LUT_W;
+	wu = yu + LUT_W;
+	xv = wu + LUT_W;
+	yv = xv + LUT_H;
+	wv = yv + LUT_H;
+
+	x1 = roi.x + roi.width;
+	x1 = x1 < mask->width ? x1 : mask->width;
+	x1 = x1 < WIDTH ? x1 : WIDTH;
+	y1 = roi.y + roi.height;
+	y1 = y1 < mask->height ? y1 : mask->height;
+	y1 = y1 < HEIGHT ? y1 : HEIGHT;
+	roi.x = roi.x < 0 ? 0 : roi.x;
+	roi.y = roi.y < 0 ? 0 : roi.y;
+
+	for (v=roi.y; v<y1; v++) {
+		unsigned char *src = (unsigned char*)mask->imageData +
+			v*mask->widthStep;
+
+		for (u=roi.x; u<x1; u+=REG_STEP) {
+			int e = u + REG_STEP < x1 ? u + REG_STEP : x1;
+			int i, n = e - u, fx, fy, dx, dy;
+			double w0, w1;
+
+			for (i=u; i<e && src[i]==0; i++)
+				;
+			if (i == e)
+				continue;
+
+			/* exact at the span ends, linear in between */
+			w0 = 65536. / (wu[u] + wv[v]);
+			w1 = 65536. / (wu[e] + wv[v]);
+			fx = (int)((xu[u] + xv[v]) * w0) - (off.x << 16);
+			fy = (int)((yu[u] + yv[v]) * w0) - (off.y << 16);
+			dx = ((int)((xu[e] + xv[v]) * w1) - (off.x << 16) - fx) / n;
+			dy = ((int)((yu[e] + yv[v]) * w1) - (off.y << 16) - fy) / n;
+
+			for (i=u; i<e; i++, fx+=dx, fy+=dy) {
+				int x = fx >> 16, y = fy >> 16;
+
+				if (src[i] == 0 || x < 0 || y < 0 ||
+				    x >= dst->width || y >= dst->height)
+					continue;
+
+				((unsigned char*)dst->imageData +
+				 y*dst->widthStep)[x] = 255;
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+/*!
+ * \brief Registration state, with the default calibration if none
+ * has been loaded.
+ *
+ * \param[in]  pipeline context
+ * \return     registration state
+ */
+static xkin_registration *get_registration (xkin_ctx *ctx)
+{
+	xkin_registration *s = &(ctx->hand.reg);
+	int i;
+
+	if (!s->loaded) {
+		memcpy(s->depth, depth_intr, sizeof(depth_intr));
+		memcpy(s->rgb, rgb_intr, sizeof(rgb_intr));
+		memcpy(s->R, R_def, sizeof(R_def));
+		memcpy(s->T, T_def, sizeof(T_def));
+		for (i=0; i<XKIN_REG_TABLES; i++)
+			s->z[i] = -1;
+		s->loaded = 1;
+	}
+
+	return s;
+}
+
+/*!
+ * \brief Lookup table of a depth.
+ *
+ * Tables are kept for the last XKIN_REG_TABLES depths, the oldest is
+ * replaced when a new depth is requested.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  depth (mm)
+ * \return     table (xu, yu, wu per column then xv, yv, wv per row)
+ */
+static double *get_table (xkin_ctx *ctx, int z)
+{
+	xkin_registration *s = get_registration(ctx);
+	int i;
+
+	for (i=0; i<XKIN_REG_TABLES; i++) {
+		if (s->lut[i] != NULL && s->z[i] == z)
+			return s->lut[i];
+	}
+
+	i = s->next;
+	s->next = (s->next + 1) % XKIN_REG_TABLES;
+
+	if (s->lut[i] == NULL) {
+		s->lut[i] = (double*)malloc(sizeof(double) * LUT_SIZE);
+		ctx->allocs++;
+	}
+
+	fill_table(s, s->lut[i], z);
+	s->z[i] = z;
+
+	return s->lut[i];
+}
+
+/*!
+ * \brief Compute the per column and per row terms of a depth.
+ *
+ * With X(u), Y(v) the back projected coordinates and Z the depth in
+ * the color camera frame, the color point is
+ * x = (fx*P0 + cx*P2) / P2 and y = (fy*P1 + cy*P2) / P2 where
+ * P = R*(X,Y,Z). Z and the translation go in the column terms.
+ *
+ * \param[in]   registration state
+ * \param[out]  table
+ * \param[in]   depth (mm)
+ */
+static void fill_table (xkin_registration *s, double *lut, int z)
+{
+	double *xu = lut, *yu = xu + LUT_W, *wu = yu + LUT_W;
+	double *xv = wu + LUT_W, *yv = xv + LUT_H, *wv = yv + LUT_H;
+	const double *R = s->R;
+	double zm = z / 1000., Z = zm + s->T[2];
+	int i;
+
+	for (i=0; i<LUT_W; i++) {
+		double X = (i - s->depth[2]) * zm / s->depth[0] + s->T[0];
+
+		xu[i] = (s->rgb[0]*R[0] + s->rgb[2]*R[6]) * X +
+			(s->rgb[0]*R[2] + s->rgb[2]*R[8]) * Z;
+		yu[i] = (s->rgb[1]*R[3] + s->rgb[3]*R[6]) * X +
+			(s->rgb[1]*R[5] + s->rgb[3]*R[8]) * Z;
+		wu[i] = R[6] * X + R[8] * Z;
+	}
+
+	for (i=0; i<LUT_H; i++) {
+		double Y = (i - s->depth[3]) * zm / s->depth[1] + s->T[1];
+
+		xv[i] = (s->rgb[0]*R[1] + s->rgb[2]*R[7]) * Y;
+		yv[i] = (s->rgb[1]*R[4] + s->rgb[3]*R[7]) * Y;
+		wv[i] = R[7] * Y;
+	}
+}
+
+/*!
+ * \brief Map a point from depth to color without tables.
+ *
+ * \param[in]  registration state
+ * \param[in]  depth point
+ * \param[in]  depth (mm)
+ * \return     color point
+ */
+static CvPoint map_point_exact (xkin_registration *s, CvPoint p, int z)
+{
+	int i, j;
+	double zm = z / 1000., tmp1[3], tmp2[3];
+
+	tmp1[0] = (p.x - s->depth[2]) * zm / s->depth[0] + s->T[0];
+	tmp1[1] = (p.y - s->depth[3]) * zm / s->depth[1] + s->T[1];
+	tmp1[2] = zm + s->T[2];
+
+	for (i=0; i<3; i++) {
+		tmp2[i] = 0;
+		for (j=0; j<3; j++)
+			tmp2[i] += s->R[3*i+j] * tmp1[j];
+	}
+
+	return cvPoint((int)(tmp2[0] * s->rgb[0] / tmp2[2] + s->rgb[2]),
+		       (int)(tmp2[1] * s->rgb[1] / tmp2[2] + s->rgb[3]));
+}
+
+/*!
+ * \brief Read fx, fy, cx, cy from a camera matrix.
+ *
+ * \param[in]   file storage
+ * \param[in]   matrix name
+ * \param[out]  intrinsics
+ * \return      1 if found, 0 otherwise
+ */
+static int read_intrinsics (CvFileStorage *fs, const char *name, double *dst)
+{
+	CvMat *K = (CvMat*)cvReadByName(fs, NULL, name, NULL);
+
+	if (K == NULL)
+		return 0;
+
+	if (K->rows != 3 || K->cols != 3) {
+		cvReleaseMat(&K);
+		return 0;
+	}
+
+	dst[0] = cvmGet(K, 0, 0);
+	dst[1] = cvmGet(K, 1, 1);
+	dst[2] = cvmGet(K, 0, 2);
+	dst[3] = cvmGet(K, 1, 2);
+	cvReleaseMat(&K);
+
+	return 1;
+}
+
+/*!
+ * \brief Read a matrix in row order.
+ *
+ * \param[in]   file storage
+ * \param[in]   matrix name
+ * \param[out]  elements
+ * \param[in]   number of elements
+ * \return      1 if found with n elements, 0 otherwise
+ */
+static int read_matrix (CvFileStorage *fs, const char *name, double *dst,
+			int n)
+{
+	CvMat *M = (CvMat*)cvReadByName(fs, NULL, name, NULL);
+	int i;
+
+	if (M == NULL)
+		return 0;
+
+	if (M->rows * M->cols != n) {
+		cvReleaseMat(&M);
+		return 0;
+	}
+
+	for (i=0; i<n; i++)
+		dst[i] = cvmGet(M, i / M->cols, i % M->cols);
+	cvReleaseMat(&M);
+
+	return 1;
+}
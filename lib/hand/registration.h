@@ -0,0 +1,17 @@
+#ifndef _REGISTRATION_H_
+#define _REGISTRATION_H_
+
+int       hand_registration_load      (const char*);
+int       hand_registration_load_ctx  (xkin_ctx*, const char*);
+void      hand_map_contour_ctx        (xkin_ctx*, xkin_contour*, int,
+				       xkin_contour*);
+int       hand_map_mask_ctx           (xkin_ctx*, IplImage*, CvRect*, int,
+				       IplImage*);
+
+CvPoint   registration_map_point      (xkin_ctx*, CvPoint, int);
+CvRect    registration_map_rect       (xkin_ctx*, CvRect, int);
+int       registration_map_mask       (xkin_ctx*, IplImage*, CvRect, int,
+				       IplImage*, CvPoint);
+
+
+#endif /* _REGISTRATION_H_ */
@@ -0,0 +1,284 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file skin.c
+ * \author Fabrizio Pedersoli
+ *
+ * Color hand segmentation. Pixels of the color ROI are classified
+ * through a 32x32x32 table indexed by the 5 most significant bits of
+ * R, G and B, read straight from the source image. The default table
+ * holds the Cr chroma of the bin centre, a skin probability table can
+ * be set instead (hand_skin_lut_ctx). The result is smoothed by a
+ * separable box filter of running sums, which also gives the
+ * histogram for the Otsu threshold; the threshold is carried between
+ * frames and changed only when a clearly better one appears.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+#include "const.h"
+#include "skin.h"
+
+#define OTSU_HYST 0.02  //!< keep the previous threshold within this loss
+
+
+static unsigned char*  get_skin_lut       (xkin_ctx*);
+static void            box_smooth         (xkin_ctx*, IplImage*, IplImage*,
+					   unsigned int*);
+static int             otsu_threshold     (unsigned int*, int, int);
+
+
+/*!
+ * \brief Set the color classification table.
+ *
+ * The table has SKIN_LUT_BINS^3 entries, the index of a pixel is
+ * (R>>3)<<10 | (G>>3)<<5 | B>>3 and higher values mean skin. The
+ * table is copied, NULL restores the Cr table.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  classification table (can be NULL)
+ */
+void hand_skin_lut_ctx (xkin_ctx *ctx, const unsigned char *lut)
+{
+	xkin_hand *s = &(ctx->hand);
+
+	free(s->skin_lut);
+	s->skin_lut = NULL;
+
+	if (lut != NULL) {
+		s->skin_lut = (unsigned char*)malloc(SKIN_LUT_SIZE);
+		memcpy(s->skin_lut, lut, SKIN_LUT_SIZE);
+		ctx->allocs++;
+	}
+	s->skin_thresh = 0;
+}
+
+/*!
+ * \brief Binary hand image from a region of the color image.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   kinect color image (RGB)
+ * \param[in]   hand's bounding box in color
+ * \param[out]  binary hand image (bounding box size)
+ */
+void skin_segmentation (xkin_ctx *ctx, IplImage *rgb, CvRect roi,
+			IplImage *dst)
+{
+	xkin_hand *s = &(ctx->hand);
+	unsigned char *lut = get_skin_lut(ctx);
+	unsigned int hist[256];
+	IplImage *cls;
+	int i, j, t;
+
+	cls = xkin_alloc_image(ctx, cvSize(roi.width, roi.height), 8, 1);
+
+	for (i=0; i<roi.height; i++) {
+		unsigned char *src = (unsigned char*)rgb->imageData +
+			(roi.y+i)*rgb->widthStep + 3*roi.x;
+		unsigned char *out = (unsigned char*)cls->imageData +
+			i*cls->widthStep;
+
+		for (j=0; j<roi.width; j++, src+=3) {
+			out[j] = lut[(src[0]>>3)<<10 | (src[1]>>3)<<5 |
+				     src[2]>>3];
+		}
+	}
+
+	box_smooth(ctx, cls, dst, hist);
+
+	t = otsu_threshold(hist, roi.width*roi.height, s->skin_thresh);
+	s->skin_thresh = t;
+
+	for (i=0; i<roi.height; i++) {
+		unsigned char *p = (unsigned char*)dst->imageData +
+			i*dst->widthStep;
+
+		for (j=0; j<roi.width; j++)
+			p[j] = p[j] > t ? 255 : 0;
+	}
+}
+
+/*!
+ * \brief Classification table, the Cr one if none has been set.
+ *
+ * Cr is computed as opencv does for CV_RGB2YCrCb, at the centre of
+ * each bin.
+ *
+ * \param[in]  pipeline context
+ * \return     classification table
+ */
+static unsigned char *get_skin_lut (xkin_ctx *ctx)
+{
+	xkin_hand *s = &(ctx->hand);
+	int r, g, b;
+
+	if (s->skin_lut != NULL)
+		return s->skin_lut;
+
+	s->skin_lut = (unsigned char*)malloc(SKIN_LUT_SIZE);
+	ctx->allocs++;
+
+	for (r=0; r<SKIN_LUT_BINS; r++) {
+		for (g=0; g<SKIN_LUT_BINS; g++) {
+			for (b=0; b<SKIN_LUT_BINS; b++) {
+				double R = 8*r + 4, G = 8*g + 4, B = 8*b + 4;
+				double Y = 0.299*R + 0.587*G + 0.114*B;
+				double cr = (R - Y) * 0.713 + 128;
+
+				cr = cr < 0 ? 0 : (cr > 255 ? 255 : cr);
+				s->skin_lut[r<<10 | g<<5 | b] =
+					(unsigned char)(cr + 0.5);
+			}
+		}
+	}
+
+	return s->skin_lut;
+}
+
+/*!
+ * \brief SKIN_BOX x SKIN_BOX mean filter, borders replicated.
+ *
+ * Column sums are kept for the current row and updated with the row
+ * entering and the one leaving the window, then each row is a running
+ * sum of column sums. The histogram of the output is computed on the
+ * way.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   source image
+ * \param[out]  smoothed image (same size)
+ * \param[out]  histogram of the smoothed image (256 bins)
+ */
+static void box_smooth (xkin_ctx *ctx, IplImage *src, IplImage *dst,
+			unsigned int *hist)
+{
+	int w = src->width, h = src->height, r = SKIN_BOX/2;
+	unsigned short *col;
+	int i, j;
+
+	col = (unsigned short*)xkin_alloc(ctx, sizeof(unsigned short) * w);
+	memset(col, 0, sizeof(unsigned short) * w);
+	memset(hist, 0, sizeof(unsigned int) * 256);
+
+	for (i=-r; i<=r; i++) {
+		unsigned char *p = (unsigned char*)src->imageData +
+			(i < 0 ? 0 : (i >= h ? h-1 : i)) * src->widthStep;
+
+		for (j=0; j<w; j++)
+			col[j] += p[j];
+	}
+
+	for (i=0; i<h; i++) {
+		unsigned char *out = (unsigned char*)dst->imageData +
+			i*dst->widthStep;
+		unsigned int sum = 0;
+
+		for (j=-r; j<=r; j++)
+			sum += col[j < 0 ? 0 : (j >= w ? w-1 : j)];
+
+		for (j=0; j<w; j++) {
+			int add = j+r+1 >= w ? w-1 : j+r+1;
+			int sub = j-r < 0 ? 0 : j-r;
+			unsigned char v = (sum + SKIN_BOX*SKIN_BOX/2) /
+				(SKIN_BOX*SKIN_BOX);
+
+			out[j] = v;
+			hist[v]++;
+			sum += col[add] - col[sub];
+		}
+
+		if (i+1 < h) {
+			unsigned char *a = (unsigned char*)src->imageData +
+				(i+r+1 >= h ? h-1 : i+r+1) * src->widthStep;
+			unsigned char *b = (unsigned char*)src->imageData +
+				(i-r < 0 ? 0 : i-r) * src->widthStep;
+
+			for (j=0; j<w; j++)
+				col[j] += a[j] - b[j];
+		}
+	}
+}
+
+/*!
+ * \brief Otsu threshold of a histogram, with hysteresis.
+ *
+ * As opencv CV_THRESH_OTSU the result t maximizes the between class
+ * variance of [0,t] and (t,255]. If the previous threshold is within
+ * OTSU_HYST of the maximum it is kept, so the segmentation does not
+ * flicker between near equivalent thresholds.
+ *
+ * \param[in]  histogram (256 bins)
+ * \param[in]  number of pixels
+ * \param[in]  previous threshold (0 none)
+ * \return     threshold
+ */
+static int otsu_threshold (unsigned int *hist, int total, int prev)
+{
+	double sum=0, sum0=0, w0=0, max=0, var_prev=0;
+	int i, t=0;
+
+	for (i=0; i<256; i++)
+		sum += (double)i * hist[i];
+
+	for (i=0; i<256; i++) {
+		double w1, m0, m1, var;
+
+		w0 += hist[i];
+		sum0 += (double)i * hist[i];
+		w1 = total - w0;
+
+		if (w0 == 0 || w1 == 0)
+			continue;
+
+		m0 = sum0 / w0;
+		m1 = (sum - sum0) / w1;
+		var = w0 * w1 * (m0 - m1) * (m0 - m1);
+
+		if (var > max) {
+			max = var;
+			t = i;
+		}
+		if (i == prev)
+			var_prev = var;
+	}
+
+	if (prev > 0 && var_prev >= max * (1 - OTSU_HYST))
+		return prev;
+
+	return t;
+}
@@ -0,0 +1,7 @@
+#ifndef _SKIN_H_
+#define _SKIN_H_
+
+void        hand_skin_lut_ctx    (xkin_ctx*, const unsigned char*);
+void        skin_segmentation    (xkin_ctx*, IplImage*, CvRect, IplImage*);
+
+#endif /* _SKIN_H_ */
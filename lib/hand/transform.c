@@ -31,9 +31,9 @@
  * \file transform.c
  * \author Fabrizio Pedersoli
  *
- * This file contains all the necessary stuff for mapping pixels from
- * depth to color. See [0] for a more complete description. The
- * transformation is characterized by the camera intrisic parameteres.
+ * This file contains the depth conversions and the regions used by
+ * the hand functions. The depth to color mapping itself is in
+ * registration.c, see [0] for a more complete description.
  *
  * [0] http://nicolas.burrus.name/index.php/Research/KinectCalibration
  */
@@ -47,138 +47,87 @@
 #include <opencv2/core/core_c.h>
 #include <opencv2/imgproc/imgproc_c.h>
 
+#include "libxkin.h"
 #include "const.h"
 #include "transform.h"
+#include "registration.h"
 
 #define XOFF 20 //20
 #define YOFF 20 //20
 
-const calibParams depthcal = { 5.9421434211923247e+02,
-			       5.9104053696870778e+02,
-                               3.3930780975300314e+02,
-			       2.4273913761751615e+02,
-                               -2.6386489753128833e-01,
-			       9.9966832163729757e-01,
-                               9.9966832163729757e-01,
-			       5.0350940090814270e-03,
-                               -1.3053628089976321e+00 };
-
-const calibParams rgbcal = { 5.2921508098293293e+02,
-			     5.2556393630057437e+02,
-                             3.2894272028759258e+02,
-			     2.6748068171871557e+02,
-                             2.6451622333009589e-01,
-			     -8.3990749424620825e-01,
-                             -1.9922302173693159e-03,
-			     1.4371995932897616e-03,
-                             9.1192465078713847e-01 };
-
-const double T[] = { 1.9985242312092553e-02,
-		     -7.4423738761617583e-04,
-		     -1.0916736334336222e-02 };
-
-const double R[][3] = { 9.9984628826577793e-01,
-			1.2635359098409581e-03,
-			-1.7487233004436643e-02,
-                        -1.4779096108364480e-03,
-			9.9992385683542895e-01,
-			-1.2251380107679535e-02,
-                        1.7470421412464927e-02,
-			1.2275341476520762e-02,
-			9.9977202419716948e-01 };
-
-
-static CvRect      map_depth_bbox_to_rgb      (CvRect,double);
-static CvPoint     map_depth_point_to_rgb     (CvPoint,double);
-
-
 /*!
- * \brief Get hand's bounding box in color. 
+ * \brief Convert a raw kinect depth value to millimetres.
  *
- * From the hand's depth contour (basic contour) it is calculated its
- * bounding box, then it is computed its equivalent in the color
- * image. The transformation consist in mapping the 4 point that
- * define the bounding box.  It is also added an offset an offset in
- * order to get a bit larger region of the hand.  
+ * See [0] for the conversion formula.
  *
- * \param[in]   hand's depth contour
- * \param[in]   hand's depth value
- * \return      rect that defines the bounding box in color image
+ * \param[in]  raw (11 bit) depth value
+ * \return     depth in millimetres, 0 if not valid
  */
-CvRect get_rgb_hand_bbox_from_depth (CvSeq *depth_cnt, int z)
+int depth_raw_to_mm (int raw)
 {
-	CvRect depth_bbox, rgb_bbox;
+	double d = raw * -0.0030711016 + 3.3309495161;
 
-	depth_bbox = cvBoundingRect(depth_cnt,0);
-	rgb_bbox = map_depth_bbox_to_rgb(depth_bbox, z);
+	if (raw <= 0 || d <= 0)
+		return 0;
 
-	rgb_bbox.x -= XOFF;
-	rgb_bbox.y -= YOFF;
-	rgb_bbox.width += XOFF;
-	rgb_bbox.height += YOFF;
-	
-	return rgb_bbox;
+	return (int)(1000. / d);
 }
 
+
 /*!
- * \brief Map a bounding box from depth to color.
+ * \brief Working region of the hand functions.
+ *
+ * The region (usually the body bounding box) is enlarged by a margin,
+ * so that filters and contour extraction are not affected by the
+ * region borders, and clipped to the image. A NULL or empty region
+ * means the whole image.
  *
- * \param[in]  hand's bounding box in depth
- * \param[in]  depth hand value
- * \return     hand's bounding box in color 
+ * \param[in]  region of interest (can be NULL)
+ * \param[in]  image size
+ * \param[in]  margin
+ * \return     working region
  */
-static CvRect map_depth_bbox_to_rgb (CvRect r, double z)
+CvRect clip_roi (CvRect *roi, CvSize size, int margin)
 {
-        CvPoint tl, tr, bl, br;
-        CvRect out;
-        
-        tl = cvPoint(r.x, r.y);
-        tr = cvPoint(r.x + r.width, r.y);
-        bl = cvPoint(r.x, r.y + r.height);
-        br = cvPoint(r.x + r.width, + r.y + r.height);
-
-        tl = map_depth_point_to_rgb(tl, z);
-        tr = map_depth_point_to_rgb(tr, z);
-        bl = map_depth_point_to_rgb(bl, z);
-        br = map_depth_point_to_rgb(br, z);
-
-        out.x = tl.x;
-        out.y = tl.y;
-        out.width = abs(tl.x - tr.x);
-        out.height = abs(tl.y - bl.y);
-        
-        return out;
+	int x0, y0, x1, y1;
+
+	if (roi == NULL || roi->width <= 0 || roi->height <= 0)
+		return cvRect(0, 0, size.width, size.height);
+
+	x0 = roi->x - margin < 0 ? 0 : roi->x - margin;
+	y0 = roi->y - margin < 0 ? 0 : roi->y - margin;
+	x1 = roi->x + roi->width + margin;
+	y1 = roi->y + roi->height + margin;
+	x1 = x1 > size.width ? size.width : x1;
+	y1 = y1 > size.height ? size.height : y1;
+
+	return cvRect(x0, y0, x1-x0, y1-y0);
 }
 
 /*!
- * \brief Single point maps from depth to color.
+ * \brief Get hand's bounding box in color. 
  *
- * \param[in]  depth point
- * \param[in]  depth value
- * \return     color point
+ * From the bounding box of the hand's depth contour (basic contour,
+ * the box of its blob) it is computed its equivalent in the color
+ * image. The transformation consist in mapping the 4 point that
+ * define the bounding box (see registration.c).  It is also added an
+ * offset an offset in order to get a bit larger region of the hand.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   hand's bounding box in depth
+ * \param[in]   hand's depth value (mm)
+ * \return      rect that defines the bounding box in color image
  */
-static CvPoint map_depth_point_to_rgb (CvPoint p, double z)
+CvRect get_rgb_hand_bbox_from_depth (xkin_ctx *ctx, CvRect depth_bbox, int z)
 {
-	int i, j;
-        CvPoint out;
-        double tmp1[3], tmp2[3];
-        
-        tmp1[0] = ((double)p.x - depthcal.cx) * z / depthcal.fx + T[0];
-        tmp1[1] = ((double)p.y - depthcal.cy) * z / depthcal.fy + T[1];
-        tmp1[2] = z + T[2];
-
-        for (i=0; i<3; i++) {
-                double sum=0;
-
-                for (j=0; j<3; j++) {
-                        sum += R[i][j] * tmp1[j];
-                }
-                tmp2[i] = sum;
-                sum=0;
-        }
-
-        out.x = (int)((tmp2[0] * rgbcal.fx / tmp2[2]) + rgbcal.cx);
-        out.y = (int)((tmp2[1] * rgbcal.fy / tmp2[2]) + rgbcal.cy);
-
-        return out;
+	CvRect rgb_bbox;
+
+	rgb_bbox = registration_map_rect(ctx, depth_bbox, z);
+
+	rgb_bbox.x -= XOFF;
+	rgb_bbox.y -= YOFF;
+	rgb_bbox.width += XOFF;
+	rgb_bbox.height += YOFF;
+	
+	return rgb_bbox;
 }
@@ -1,16 +1,9 @@
 #ifndef _TRANSFORM_H_
 #define _TRANSFORM_H_
 
-typedef struct calibParams {
-        double fx, fy;
-        double cx, cy;
-        double k1, k2;
-        double p1, p2;
-        double k3;
-} calibParams;
-
-
-CvRect        get_rgb_hand_bbox_from_depth       (CvSeq*,int);
+CvRect        get_rgb_hand_bbox_from_depth       (xkin_ctx*,CvRect,int);
+int           depth_raw_to_mm                    (int);
+CvRect        clip_roi                           (CvRect*,CvSize,int);
 
 
 #endif /* _TRANSFORM_H_ */
@@ -2,7 +2,7 @@
 #define _CONST_H_
 
 enum {
-	BUFFLEN=5,
+	BUFFLEN=XKIN_BUFFLEN,
 	POLY_APPROX_PRECISION=10,
 	NUM_DEFECTS=4,
 	DEFECTS_DEPTH_FACTOR=6,
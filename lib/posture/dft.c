@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file dft.c
+ * \author Fabrizio Pedersoli
+ *
+ * Direct DFT of the few bins the fourier descriptors use.
+ *
+ * The descriptors read only the bins 1..FD_NUM+1 of the SAMPLES_NUM
+ * points spectrum, which are computed here as dot products of the
+ * contour samples with precomputed twiddle rows, one row per bin:
+ * (FD_NUM+1)*SAMPLES_NUM complex multiply-adds, against the full
+ * FFT. Unlike a Goertzel recursion the error does not grow with the
+ * number of samples. It also lets the posture library work without
+ * FFTW.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libxkin.h"
+#include "const.h"
+#include "dft.h"
+
+
+static double tw_cos[DFT_BINS][SAMPLES_NUM]; //!< cos(2 pi k n / N)
+static double tw_sin[DFT_BINS][SAMPLES_NUM]; //!< sin(2 pi k n / N)
+static pthread_once_t tw_once = PTHREAD_ONCE_INIT;
+
+
+static void        twiddle_init   (void);
+static void        dft_bin        (const double*, const double*,
+				   const double*, double*);
+
+
+/*!
+ * \brief Forward DFT bins DFT_FIRST..DFT_FIRST+DFT_BINS-1.
+ *
+ * The sign convention is the one of FFTW_FORWARD, bins not computed
+ * are left untouched.
+ *
+ * \param[in]   SAMPLES_NUM complex samples (interleaved re, im)
+ * \param[out]  SAMPLES_NUM complex spectrum (interleaved re, im)
+ */
+void dft_bins (const double *in, double *out)
+{
+	int k;
+
+	pthread_once(&tw_once, twiddle_init);
+
+	for (k=0; k<DFT_BINS; k++) {
+		dft_bin(in, tw_cos[k], tw_sin[k], out + 2*(DFT_FIRST+k));
+	}
+}
+
+/*!
+ * \brief Fill the twiddle rows.
+ *
+ * Rows are built from one period of the unit circle, indexed by
+ * k*n mod N, so that equal angles give bitwise equal factors.
+ */
+static void twiddle_init (void)
+{
+	double c[SAMPLES_NUM], s[SAMPLES_NUM];
+	int k, n;
+
+	for (n=0; n<SAMPLES_NUM; n++) {
+		c[n] = cos(2*CV_PI*n/SAMPLES_NUM);
+		s[n] = sin(2*CV_PI*n/SAMPLES_NUM);
+	}
+	for (k=0; k<DFT_BINS; k++) {
+		for (n=0; n<SAMPLES_NUM; n++) {
+			int m = ((DFT_FIRST+k)*n) % SAMPLES_NUM;
+
+			tw_cos[k][n] = c[m];
+			tw_sin[k][n] = s[m];
+		}
+	}
+}
+
+/*!
+ * \brief One DFT bin.
+ *
+ * X = sum (x + iy)(c - is) = sum (xc + ys) + i(yc - xs)
+ *
+ * \param[in]   complex samples
+ * \param[in]   cos row
+ * \param[in]   sin row
+ * \param[out]  bin (re, im)
+ */
+static void dft_bin (const double *z, const double *c, const double *s,
+		     double *X)
+{
+	int n=0;
+	double zc[2] = {0, 0}, zs[2] = {0, 0};
+
+#if defined(__SSE2__)
+	/* (x, y) times c and s, two accumulators each to hide latency */
+	__m128d ac0 = _mm_setzero_pd(), ac1 = _mm_setzero_pd();
+	__m128d as0 = _mm_setzero_pd(), as1 = _mm_setzero_pd();
+
+	for (; n+2<=SAMPLES_NUM; n+=2) {
+		__m128d z0 = _mm_loadu_pd(z + 2*n);
+		__m128d z1 = _mm_loadu_pd(z + 2*n + 2);
+
+		ac0 = _mm_add_pd(ac0, _mm_mul_pd(z0, _mm_load1_pd(c+n)));
+		as0 = _mm_add_pd(as0, _mm_mul_pd(z0, _mm_load1_pd(s+n)));
+		ac1 = _mm_add_pd(ac1, _mm_mul_pd(z1, _mm_load1_pd(c+n+1)));
+		as1 = _mm_add_pd(as1, _mm_mul_pd(z1, _mm_load1_pd(s+n+1)));
+	}
+	_mm_storeu_pd(zc, _mm_add_pd(ac0, ac1));
+	_mm_storeu_pd(zs, _mm_add_pd(as0, as1));
+#endif
+	for (; n<SAMPLES_NUM; n++) {
+		zc[0] += z[2*n] * c[n];
+		zc[1] += z[2*n+1] * c[n];
+		zs[0] += z[2*n] * s[n];
+		zs[1] += z[2*n+1] * s[n];
+	}
+
+	X[0] = zc[0] + zs[1];
+	X[1] = zc[1] - zs[0];
+}
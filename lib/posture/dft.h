@@ -0,0 +1,11 @@
+#ifndef _DFT_H_
+#define _DFT_H_
+
+enum {
+	DFT_FIRST=1,          //!< first bin used by the descriptors
+	DFT_BINS=FD_NUM+1     //!< number of bins used by the descriptors
+};
+
+void       dft_bins            (const double *in, double *out);
+
+#endif /* _DFT_H_ */
@@ -34,27 +34,59 @@
  * This file implements the descriptors [0] used for the posture
  * classification which is done on the contour of the hand.
  *
+ * The spectrum is computed by one of two backends, chosen per context
+ * with ctx->posture.descriptors: FFTW, or the direct DFT of the bins
+ * actually used (dft.c). Without FFTW the direct DFT is always used.
+ *
+ * The FFT of each context is planned once, with FFTW_MEASURE or
+ * FFTW_PATIENT, on buffers kept for the context lifetime. Planning
+ * can be skipped at start up by loading the FFTW wisdom of a previous
+ * run (posture_fft_init_ctx).
+ *
  * [0] http://fourier.eng.hmc.edu/e161/lectures/fd/node1.html
  */
 
 #include "config.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
 #include <opencv2/core/core_c.h>
-#include <opencv2/imgproc/imgproc_c.h>
+#if HAVE_FFTW
 #include <fftw3.h>
+#endif
 
+#include "libxkin.h"
 #include "const.h"
+#include "dft.h"
 #include "fourierdesc.h"
 
 
-static void        get_coefficients      (fftw_complex*, double*);
-static void        fftw_fill_data        (CvSeq*, fftw_complex*);
-static void        fftw_fill_data        (CvSeq*, fftw_complex*);
+/*!
+ * \brief Descriptor engine: the FFT plan and its buffers.
+ *
+ * Buffers are interleaved (re, im) pairs, the layout of fftw_complex.
+ */
+typedef struct fd_engine {
+	double *in;              //!< contour samples
+	double *out;             //!< spectrum
+#if HAVE_FFTW
+	fftw_plan plan;          //!< SAMPLES_NUM forward plan (or NULL)
+#endif
+} fd_engine;
+
+#if HAVE_FFTW
+/* the FFTW planner is not thread safe */
+static pthread_mutex_t planner = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+static fd_engine*  engine_create         (xkin_ctx*);
+static void        engine_plan           (fd_engine*, int);
+static void        engine_free           (void*);
+static void        get_coefficients      (double*, double*);
 static void        cvmat_fill_data       (CvMat*, double*);
-static CvSeq*      contour_sampling      (CvSeq*, int);
-static void        seq_to_mat            (CvSeq*, CvMat*, CvMat*);
-static void        mat_to_seq            (CvMat*, CvMat*, CvSeq*, int);
 
 
 /*!
@@ -69,66 +101,210 @@ static void        mat_to_seq            (CvMat*, CvMat*, CvSeq*, int);
  */
 CvMat *get_fourier_descriptors (CvSeq *cnt)
 {
-	CvSeq *samples;
-	static CvMat *desc=NULL;
+	xkin_ctx *ctx = xkin_default_ctx();
+
+	ctx->allocs += xkin_contour_from_seq(&(ctx->posture.input), cnt);
+
+	return get_fourier_descriptors_ctx(ctx, &(ctx->posture.input));
+}
+
+/*!
+ * \brief Computes fourier descriptors of a contour using a pipeline
+ * context.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  contour
+ * \return     vector of descriptors (owned by the context)
+ */
+CvMat *get_fourier_descriptors_ctx (xkin_ctx *ctx, xkin_contour *cnt)
+{
+	xkin_posture *s = &(ctx->posture);
 	double fd[FD_NUM];
-	fftw_complex *in, *out;
-	fftw_plan forward;
+	fd_engine *e;
 
-	if (desc==NULL) {
-		desc = cvCreateMat(1, FD_NUM, CV_64FC1);
+	if (s->desc==NULL) {
+		s->desc = cvCreateMat(1, FD_NUM, CV_64FC1);
 	} else {
-		cvZero(desc);
+		cvZero(s->desc);
 	}
 
-	samples = contour_sampling(cnt, SAMPLES_NUM);
-		
-	in  = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*SAMPLES_NUM);
-	out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex)*SAMPLES_NUM);
-	fftw_fill_data(samples, in);
+	e = (s->fft == NULL) ? engine_create(ctx) : (fd_engine*)s->fft;
+
+#if HAVE_FFTW
+	/* planning overwrites the buffers, done before filling them */
+	if (s->descriptors == XKIN_FD_FFTW && e->plan == NULL)
+		engine_plan(e, XKIN_FFT_MEASURE);
+#endif
 
-	forward = fftw_plan_dft_1d(SAMPLES_NUM, in, out,
-				   FFTW_FORWARD, FFTW_ESTIMATE);
-	fftw_execute(forward);
+	contour_sampling(cnt, e->in, SAMPLES_NUM);
+
+#if HAVE_FFTW
+	if (s->descriptors == XKIN_FD_FFTW) {
+		fftw_execute(e->plan);
+	} else {
+		dft_bins(e->in, e->out);
+	}
+#else
+	dft_bins(e->in, e->out);
+#endif
 	
-	get_coefficients(out, fd);
-	cvmat_fill_data(desc, fd);
+	get_coefficients(e->out, fd);
+	cvmat_fill_data(s->desc, fd);
+
+	return s->desc;
+}
+
+/*!
+ * \brief Plan the descriptors FFT.
+ *
+ * See posture_fft_init_ctx.
+ *
+ * \param[in]  FFTW wisdom file (can be NULL)
+ * \param[in]  planning effort (XKIN_FFT_*)
+ * \return     1 if the wisdom has been saved, 0 otherwise
+ */
+int posture_fft_init (const char *wisdom, int effort)
+{
+	return posture_fft_init_ctx(xkin_default_ctx(), wisdom, effort);
+}
+
+/*!
+ * \brief Plan the descriptors FFT of a pipeline context.
+ *
+ * Meant for start up: the wisdom in the file (if any) is loaded, the
+ * plan is made with the given effort, which is immediate if the
+ * wisdom covers it, and the wisdom is saved back to the file. Without
+ * this call the plan is made with XKIN_FFT_MEASURE on the first
+ * descriptors computation. Without FFTW only the buffers are made.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  FFTW wisdom file (can be NULL)
+ * \param[in]  planning effort (XKIN_FFT_*)
+ * \return     1 if the wisdom has been saved, 0 otherwise
+ */
+int posture_fft_init_ctx (xkin_ctx *ctx, const char *wisdom, int effort)
+{
+	xkin_posture *s = &(ctx->posture);
+	fd_engine *e;
+	int saved = 0;
+
+	if (s->fft != NULL) {
+		s->fft_free(s->fft);
+		s->fft = NULL;
+	}
+	e = engine_create(ctx);
+
+#if HAVE_FFTW
+	if (wisdom != NULL) {
+		pthread_mutex_lock(&planner);
+		fftw_import_wisdom_from_filename(wisdom);
+		pthread_mutex_unlock(&planner);
+	}
+
+	engine_plan(e, effort);
+
+	if (wisdom != NULL) {
+		pthread_mutex_lock(&planner);
+		saved = fftw_export_wisdom_to_filename(wisdom);
+		pthread_mutex_unlock(&planner);
+	}
+#endif
+
+	return saved;
+}
 
-	return desc;
+/*!
+ * \brief Create the descriptor engine of a context, not planned.
+ *
+ * \param[in]  pipeline context
+ * \return     engine (also set in the context)
+ */
+static fd_engine *engine_create (xkin_ctx *ctx)
+{
+	xkin_posture *s = &(ctx->posture);
+	size_t size = sizeof(double) * 2 * SAMPLES_NUM;
+	fd_engine *e;
+
+	e = (fd_engine*)malloc(sizeof(fd_engine));
+#if HAVE_FFTW
+	e->in  = (double*)fftw_malloc(size);
+	e->out = (double*)fftw_malloc(size);
+	e->plan = NULL;
+#else
+	e->in  = (double*)cvAlloc(size);
+	e->out = (double*)cvAlloc(size);
+#endif
+
+	s->fft = e;
+	s->fft_free = engine_free;
+	ctx->allocs += 3;
+
+	return e;
+}
+
+/*!
+ * \brief Plan the FFT of a descriptor engine (FFTW only).
+ *
+ * \param[in]  engine
+ * \param[in]  planning effort (XKIN_FFT_*)
+ */
+static void engine_plan (fd_engine *e, int effort)
+{
+#if HAVE_FFTW
+	pthread_mutex_lock(&planner);
+	if (e->plan != NULL)
+		fftw_destroy_plan(e->plan);
+	e->plan = fftw_plan_dft_1d(SAMPLES_NUM, (fftw_complex*)e->in,
+				   (fftw_complex*)e->out, FFTW_FORWARD,
+				   effort == XKIN_FFT_PATIENT ?
+				   FFTW_PATIENT : FFTW_MEASURE);
+	pthread_mutex_unlock(&planner);
+#endif
+}
+
+/*!
+ * \brief Free a descriptor engine.
+ *
+ * \param[in]  engine
+ */
+static void engine_free (void *p)
+{
+	fd_engine *e = (fd_engine*)p;
+
+#if HAVE_FFTW
+	if (e->plan != NULL) {
+		pthread_mutex_lock(&planner);
+		fftw_destroy_plan(e->plan);
+		pthread_mutex_unlock(&planner);
+	}
+	fftw_free(e->in);
+	fftw_free(e->out);
+#else
+	cvFree(&(e->in));
+	cvFree(&(e->out));
+#endif
+	free(e);
 }
 
 /*!
  * \brief Computes the fourier coefficients.
  *
- * \param[in]   complex signal
+ * \param[in]   spectrum (interleaved re, im)
  * \param[out]  descriptors
  */
-static void get_coefficients (fftw_complex *data, double *desc)
+static void get_coefficients (double *data, double *desc)
 {
 	size_t i;
-	double C1 = sqrt( pow(data[1][0],2) + pow(data[1][1],2) );
+	double C1 = sqrt( pow(data[2],2) + pow(data[3],2) );
 	
 	for (i=0; i<FD_NUM; i++) {
 		double tmp;
 
-		tmp = sqrt( pow(data[i+2][0],2) + pow(data[i+2][1],2) );
+		tmp = sqrt( pow(data[2*i+4],2) + pow(data[2*i+5],2) );
 		desc[i] =  tmp/C1;
 	}	
 }
 
-static void fftw_fill_data (CvSeq *seq, fftw_complex *data)
-{
-	size_t i;
-
-	for (i=0; i<seq->total; i++) {
-		CvPoint *p;
-
-		p = CV_GET_SEQ_ELEM(CvPoint, seq, i);
-		data[i][0] = p->x;
-		data[i][1] = p->y;
-	}
-}
-
 static void cvmat_fill_data (CvMat *M, double *data)
 {
 	size_t i;
@@ -145,66 +321,53 @@ static void cvmat_fill_data (CvMat *M, double *data)
  * signal have must have always the same number of samples. For this
  * the contour must be redefined through proper interpolation.
  *
- * \param[in]  contour
- * \param[in]  target number of points
- * \return     resampled contour     
+ * The closed contour is walked once and sampled at N points equally
+ * spaced along its perimeter, linearly interpolated inside each
+ * segment, so that the samples do not depend on how the contour
+ * points are spaced. Samples are written as complex numbers x + iy.
+ *
+ * \param[in]   contour
+ * \param[out]  N complex samples (interleaved re, im)
+ * \param[in]   target number of points
  */
-static CvSeq *contour_sampling (CvSeq *contour, int N)
+void contour_sampling (xkin_contour *contour, double *z, int N)
 {
-	CvSeq *samples;
-	static CvMemStorage *str=NULL;
-	CvMat *xi = cvCreateMat(1, contour->total, CV_64FC1);
-	CvMat *yi = cvCreateMat(1, contour->total, CV_64FC1);
-	CvMat *xf = cvCreateMat(1, N, CV_64FC1);
-	CvMat *yf = cvCreateMat(1, N, CV_64FC1);
-
-	seq_to_mat(contour, xi, yi);
-
-	cvResize(xi, xf, CV_INTER_LINEAR);
-	cvResize(yi, yf, CV_INTER_LINEAR);
+	const int *x = contour->x, *y = contour->y;
+	int num = contour->num;
+	double len = 0, step, t, acc, seg;
+	int i, j;
 
-	if (str == NULL) {
-		str = cvCreateMemStorage(0);
-	} else {
-		cvClearMemStorage(str);
+	if (num == 0) {
+		for (j=0; j<2*N; j++)
+			z[j] = 0;
+		return;
 	}
-	
-	samples = cvCreateSeq(CV_SEQ_ELTYPE_POINT, sizeof(CvSeq),
-			      sizeof(CvPoint), str);
 
-	mat_to_seq(xf, yf, samples, N);
+	for (i=0; i<num; i++) {
+		int k = (i+1 < num) ? i+1 : 0;
 
-	cvReleaseMat(&xi);
-	cvReleaseMat(&yi);
-	cvReleaseMat(&xf);
-	cvReleaseMat(&yf);
-	
-	return samples;
-}
-
-static void seq_to_mat (CvSeq *cont, CvMat *Mx, CvMat *My)
-{
-	size_t i;
-	
-	for (i=0; i<cont->total; i++) {
-		CvPoint *p = CV_GET_SEQ_ELEM(CvPoint, cont, i);
-
-		((double*)Mx->data.fl)[i] = p->x;
-		((double*)My->data.fl)[i] = p->y;
+		len += hypot(x[k] - x[i], y[k] - y[i]);
 	}
-}
+	step = len / N;
 
-static void mat_to_seq (CvMat *Mx, CvMat *My, CvSeq *cont, int N)
-{
-	size_t i;
-	int x,y;
-	CvPoint p;
-	
-	for (i=0; i<N; i++) {
-		x = (int)((double*)Mx->data.fl)[i];
-		y = (int)((double*)My->data.fl)[i];
+	/* segment i goes from point i to point i+1 (or 0) */
+	i = 0;
+	acc = 0;
+	seg = (num > 1) ? hypot(x[1] - x[0], y[1] - y[0]) : 0;
+	for (j=0; j<N; j++) {
+		int k;
+		double a;
 
-		p = cvPoint(x,y);
-		cvSeqPush(cont, &p);
+		t = j * step;
+		while (acc + seg <= t && i < num-1) {
+			acc += seg;
+			i++;
+			k = (i+1 < num) ? i+1 : 0;
+			seg = hypot(x[k] - x[i], y[k] - y[i]);
+		}
+		k = (i+1 < num) ? i+1 : 0;
+		a = (seg > 0) ? (t - acc) / seg : 0;
+		z[2*j] = x[i] + a * (x[k] - x[i]);
+		z[2*j+1] = y[i] + a * (y[k] - y[i]);
 	}
 }
@@ -3,6 +3,12 @@
 
 
 CvMat*     get_fourier_descriptors      (CvSeq *cnt);
+CvMat*     get_fourier_descriptors_ctx  (xkin_ctx *ctx, xkin_contour *cnt);
+void       contour_sampling             (xkin_contour *contour, double *z,
+					 int N);
+int        posture_fft_init             (const char *wisdom, int effort);
+int        posture_fft_init_ctx         (xkin_ctx *ctx, const char *wisdom,
+					 int effort);
 
 
 #endif /* _FOURIERDESC_H_ */
@@ -0,0 +1,265 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file models.c
+ * \author Fabrizio Pedersoli
+ *
+ * Compiled posture model set for the Mahalanobis classification.
+ *
+ * The model cov matrix is the inverse covariance P (see
+ * trainposture), factorized once as P = U'U with U upper triangular
+ * (Cholesky), so that the squared distance is a sum of squares:
+ *
+ *   d^2 = |U (x - m)|^2 = sum_i ( sum_{j>=i} U_ij (x_j - m_j) )^2
+ *
+ * Partial sums only grow, so a model is abandoned as soon as its
+ * partial sum exceeds the best distance found so far.
+ *
+ * Models are stored in pairs, one per SSE2 lane, in a single aligned
+ * block: for each pair the FD_NUM means followed by the packed rows of
+ * U, every value interleaved as (model 2b, model 2b+1). An odd set is
+ * padded with a copy of its last model.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <opencv2/core/core_c.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "libxkin.h"
+#include "const.h"
+#include "posture.h"
+#include "models.h"
+
+#define LANES 2                              //!< models per pair
+#define TRI (FD_NUM*(FD_NUM+1)/2)            //!< packed U length
+#define PAIR (LANES*(FD_NUM+TRI))            //!< doubles per pair
+
+
+static int         cholesky_upper     (const CvMat*, double*);
+static void        pair_distance      (const double*, const double*,
+				       double, double*);
+
+
+/*!
+ * \brief Compile a set of posture models.
+ *
+ * \param[in]  array of posture models
+ * \param[in]  number of models
+ * \return     model set, NULL if a cov matrix is not positive definite
+ */
+CvPostModelSet *posture_models_compile (CvPostModel *mo, int num)
+{
+	CvPostModelSet *set;
+	double tri[TRI];
+	int i, j;
+
+	if (num <= 0)
+		return NULL;
+
+	set = (CvPostModelSet*)malloc(sizeof(CvPostModelSet));
+	set->num = num;
+	set->pairs = (num + LANES-1) / LANES;
+	set->type = (int*)malloc(sizeof(int) * num);
+	set->data = (double*)cvAlloc(sizeof(double) * PAIR * set->pairs);
+
+	for (i=0; i<LANES*set->pairs; i++) {
+		const CvPostModel *m = &mo[i < num ? i : num-1];
+		double *p = set->data + PAIR*(i/LANES) + i%LANES;
+
+		if (!cholesky_upper(m->cov, tri)) {
+			posture_models_release(&set);
+			return NULL;
+		}
+		for (j=0; j<FD_NUM; j++)
+			p[LANES*j] = cvmGet(m->mean, 0, j);
+		for (j=0; j<TRI; j++)
+			p[LANES*(FD_NUM+j)] = tri[j];
+		if (i < num)
+			set->type[i] = m->type;
+	}
+
+	return set;
+}
+
+/*!
+ * \brief Release a compiled set of posture models.
+ *
+ * \param[in]  model set (set to NULL)
+ */
+void posture_models_release (CvPostModelSet **set)
+{
+	if (*set == NULL)
+		return;
+
+	cvFree(&((*set)->data));
+	free((*set)->type);
+	free(*set);
+	*set = NULL;
+}
+
+/*!
+ * \brief Nearest model of a descriptors vector.
+ *
+ * \param[in]   model set
+ * \param[in]   fourier descriptors vector (1 x FD_NUM, double)
+ * \param[out]  Mahalanobis distance to the nearest model (can be NULL)
+ * \return      index of the nearest model
+ */
+int posture_models_classify (CvPostModelSet *set, CvMat *fd, double *dist)
+{
+	double x[FD_NUM], best = DBL_MAX;
+	int b, j, argmin = 0;
+
+	for (j=0; j<FD_NUM; j++)
+		x[j] = cvmGet(fd, 0, j);
+
+	for (b=0; b<set->pairs; b++) {
+		double d[LANES];
+		int l;
+
+		pair_distance(set->data + PAIR*b, x, best, d);
+		for (l=0; l<LANES; l++) {
+			if (d[l] < best) {
+				best = d[l];
+				argmin = LANES*b + l;
+			}
+		}
+	}
+
+	if (dist != NULL)
+		*dist = sqrt(best);
+
+	return argmin;
+}
+
+/*!
+ * \brief Squared distances of a pair of models.
+ *
+ * Rows of U are accumulated until both partial sums reach the bound,
+ * in which case the partial sums are returned: they are not smaller
+ * than the bound, so the pair loses anyway.
+ *
+ * \param[in]   model pair
+ * \param[in]   descriptors
+ * \param[in]   bound (best squared distance so far)
+ * \param[out]  squared distances
+ */
+static void pair_distance (const double *p, const double *x, double bound,
+			   double *d)
+{
+	const double *u = p + LANES*FD_NUM;
+	int i, j;
+
+#if defined(__SSE2__)
+	__m128d diff[FD_NUM], acc = _mm_setzero_pd();
+	__m128d lim = _mm_set1_pd(bound);
+
+	for (j=0; j<FD_NUM; j++)
+		diff[j] = _mm_sub_pd(_mm_set1_pd(x[j]),
+				     _mm_load_pd(p + LANES*j));
+
+	for (i=0; i<FD_NUM; i++) {
+		__m128d r = _mm_setzero_pd();
+
+		for (j=i; j<FD_NUM; j++, u+=LANES)
+			r = _mm_add_pd(r, _mm_mul_pd(_mm_load_pd(u), diff[j]));
+		acc = _mm_add_pd(acc, _mm_mul_pd(r, r));
+
+		if (_mm_movemask_pd(_mm_cmplt_pd(acc, lim)) == 0)
+			break;
+	}
+	_mm_storeu_pd(d, acc);
+#else
+	double diff[FD_NUM][LANES];
+	int l;
+
+	for (j=0; j<FD_NUM; j++)
+		for (l=0; l<LANES; l++)
+			diff[j][l] = x[j] - p[LANES*j + l];
+
+	d[0] = d[1] = 0;
+	for (i=0; i<FD_NUM; i++) {
+		double r[LANES] = {0, 0};
+
+		for (j=i; j<FD_NUM; j++, u+=LANES)
+			for (l=0; l<LANES; l++)
+				r[l] += u[l] * diff[j][l];
+		for (l=0; l<LANES; l++)
+			d[l] += r[l] * r[l];
+
+		if (d[0] >= bound && d[1] >= bound)
+			break;
+	}
+#endif
+}
+
+/*!
+ * \brief Cholesky factor of a positive definite matrix.
+ *
+ * \param[in]   FD_NUM x FD_NUM symmetric matrix P
+ * \param[out]  U with P = U'U, rows of the upper triangle packed
+ * \return      0 if P is not positive definite, 1 otherwise
+ */
+static int cholesky_upper (const CvMat *P, double *u)
+{
+	double U[FD_NUM][FD_NUM];
+	int i, j, k, n=0;
+
+	for (i=0; i<FD_NUM; i++) {
+		for (j=i; j<FD_NUM; j++) {
+			double s = cvmGet(P, i, j);
+
+			for (k=0; k<i; k++)
+				s -= U[k][i] * U[k][j];
+
+			if (i == j) {
+				if (s <= 0)
+					return 0;
+				U[i][i] = sqrt(s);
+			} else {
+				U[i][j] = s / U[i][i];
+			}
+		}
+	}
+
+	for (i=0; i<FD_NUM; i++)
+		for (j=i; j<FD_NUM; j++)
+			u[n++] = U[i][j];
+
+	return 1;
+}
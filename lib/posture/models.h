@@ -0,0 +1,9 @@
+#ifndef _MODELS_H_
+#define _MODELS_H_
+
+CvPostModelSet*  posture_models_compile   (CvPostModel *mo, int num);
+void             posture_models_release   (CvPostModelSet **set);
+int              posture_models_classify  (CvPostModelSet *set, CvMat *fd,
+					   double *dist);
+
+#endif /* _MODELS_H_ */
@@ -43,21 +43,26 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <float.h>
 #include <opencv2/core/core_c.h>
 #include <opencv2/imgproc/imgproc_c.h>
 #include <opencv2/highgui/highgui_c.h>
 
+#include "libxkin.h"
 #include "const.h"
 #include "fourierdesc.h"
 #include "posture.h"
+#include "models.h"
+#include "voter.h"
 
 
 static int        is_hand_closed                 (CvSeq*, CvSeq*);
 static float      get_defects_mean_depth         (CvSeq*);
 static int        validate_mean_defects_depth    (CvSeq*, CvSeq*);
-static CvSeq*     contour_approximation          (CvSeq*);
-static int        fd_argmin_distance             (CvMat*, CvPostModel*, int);
-static int        majority_classification        (int, int);
+static CvSeq*     contour_approximation          (xkin_ctx*, xkin_contour*);
+static int        fd_argmin_distance             (CvMat*, CvPostModel*, int,
+						  double*);
+static double     confidence                     (double);
 
 
 /*!
@@ -72,23 +77,41 @@ static int        majority_classification        (int, int);
  */
 int basic_posture_classification (CvSeq *ctr)
 {
+	xkin_ctx *ctx = xkin_default_ctx();
+
+	ctx->allocs += xkin_contour_from_seq(&(ctx->posture.input), ctr);
+
+	return basic_posture_classification_ctx(ctx, &(ctx->posture.input));
+}
+
+/*!
+ * \brief Classify an hand contour in open or close using a pipeline
+ * context.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   hand's contour (basic)
+ * \return      classification index 
+ */
+int basic_posture_classification_ctx (xkin_ctx *ctx, xkin_contour *ctr)
+{
+	xkin_posture *s = &(ctx->posture);
 	int posture=0;
 	CvSeq *pol, *hull, *def;
-	static CvMemStorage *s1=NULL, *s2=NULL;
 	
-	if (s1 == NULL && s2 == NULL) {
-		s1 = cvCreateMemStorage(0);
-		s2 = cvCreateMemStorage(0);
+	if (s->hull == NULL && s->defects == NULL) {
+		s->hull = cvCreateMemStorage(0);
+		s->defects = cvCreateMemStorage(0);
 	} else {
-		cvClearMemStorage(s1);
-		cvClearMemStorage(s2);
+		cvClearMemStorage(s->hull);
+		cvClearMemStorage(s->defects);
 	}
 
-	pol  = contour_approximation(ctr);
-	hull = cvConvexHull2(pol, s1, CV_CLOCKWISE, 0);
-	def  = cvConvexityDefects(pol, hull, s2);
+	pol  = contour_approximation(ctx, ctr);
+	hull = cvConvexHull2(pol, s->hull, CV_CLOCKWISE, 0);
+	def  = cvConvexityDefects(pol, hull, s->defects);
 	posture = is_hand_closed(pol, def) ? HAND_CLOSE : HAND_OPEN;
-	posture = majority_classification(posture, 2);
+	ctx->allocs += voter_reserve(&(s->basic), 2);
+	posture = voter_update(&(s->basic), posture, 1.0);
 	
 	return posture;
 }
@@ -109,13 +132,92 @@ int basic_posture_classification (CvSeq *ctr)
  * \return      classification index 
  */
 int advanced_posture_classification (CvSeq *cnt, CvPostModel *mo, int num)
+{
+	xkin_ctx *ctx = xkin_default_ctx();
+
+	ctx->allocs += xkin_contour_from_seq(&(ctx->posture.input), cnt);
+
+	return advanced_posture_classification_ctx(ctx, &(ctx->posture.input),
+						   mo, num);
+}
+
+/*!
+ * \brief Classify an hand contour in many posture (> 2) using a
+ * pipeline context.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   hand's contour in the color image
+ * \param[in]   array of posture models
+ * \param[in]   number of models
+ * \return      classification index 
+ */
+int advanced_posture_classification_ctx (xkin_ctx *ctx, xkin_contour *cnt,
+					 CvPostModel *mo, int num)
 {
 	int posture;
+	double dist;
 	CvMat *fd;
 
-	fd = get_fourier_descriptors(cnt);
-	posture = fd_argmin_distance(fd, mo, num);
-	posture = majority_classification(posture, num);
+	fd = get_fourier_descriptors_ctx(ctx, cnt);
+	posture = fd_argmin_distance(fd, mo, num, &dist);
+	ctx->allocs += voter_reserve(&(ctx->posture.advanced), num);
+	posture = voter_update(&(ctx->posture.advanced), posture,
+			       confidence(dist));
+	
+	return posture;
+}
+
+/*!
+ * \brief Classify an hand contour with a compiled model set.
+ *
+ * Same as advanced_posture_classification, the models are compiled
+ * once with posture_models_compile. The distance to the nearest
+ * model of the current frame is returned to allow rejecting postures
+ * which do not match any model.
+ *
+ * \param[in]   hand's contour in the color image
+ * \param[in]   compiled posture models
+ * \param[out]  Mahalanobis distance of the frame (can be NULL)
+ * \return      classification index 
+ */
+int advanced_posture_classification_set (CvSeq *cnt, CvPostModelSet *set,
+					 double *dist)
+{
+	xkin_ctx *ctx = xkin_default_ctx();
+
+	ctx->allocs += xkin_contour_from_seq(&(ctx->posture.input), cnt);
+
+	return advanced_posture_classification_set_ctx(ctx,
+						       &(ctx->posture.input),
+						       set, dist);
+}
+
+/*!
+ * \brief Classify an hand contour with a compiled model set using a
+ * pipeline context.
+ *
+ * \param[in]   pipeline context
+ * \param[in]   hand's contour in the color image
+ * \param[in]   compiled posture models
+ * \param[out]  Mahalanobis distance of the frame (can be NULL)
+ * \return      classification index 
+ */
+int advanced_posture_classification_set_ctx (xkin_ctx *ctx,
+					     xkin_contour *cnt,
+					     CvPostModelSet *set,
+					     double *dist)
+{
+	int posture;
+	double d;
+	CvMat *fd;
+
+	fd = get_fourier_descriptors_ctx(ctx, cnt);
+	posture = posture_models_classify(set, fd, &d);
+	ctx->allocs += voter_reserve(&(ctx->posture.advanced), set->num);
+	posture = voter_update(&(ctx->posture.advanced), posture,
+			       confidence(d));
+	if (dist != NULL)
+		*dist = d;
 	
 	return posture;
 }
@@ -184,22 +286,33 @@ static float get_defects_mean_depth (CvSeq* def)
 /*!
  * \brief Compute a polygon approximantion of a contour.
  *
+ * The points are interleaved in frame memory and given to opencv as
+ * a point matrix.
+ *
+ * \param[in]  pipeline context
  * \param[in]  contour
  * \return     polygon approximation 
  */
-static CvSeq *contour_approximation (CvSeq *contour)
+static CvSeq *contour_approximation (xkin_ctx *ctx, xkin_contour *contour)
 {
-	static CvMemStorage *storage=NULL;
+	xkin_posture *s = &(ctx->posture);
 	CvSeq *poly;
+	CvPoint *pts;
+	CvMat mat;
 
-	if (storage == NULL)
-		storage = cvCreateMemStorage(0);
+	if (s->poly == NULL)
+		s->poly = cvCreateMemStorage(0);
 	else
-		cvClearMemStorage(storage);
+		cvClearMemStorage(s->poly);
+
+	pts = (CvPoint*)xkin_alloc(ctx, sizeof(CvPoint) * contour->num);
+	xkin_contour_points(contour, pts);
+	mat = cvMat(1, contour->num, CV_32SC2, pts);
 	
-	poly = cvApproxPoly(contour, sizeof(CvContour), storage,
+	/* a point matrix is closed only if asked (a contour sequence is) */
+	poly = cvApproxPoly(&mat, sizeof(CvContour), s->poly,
 			    CV_POLY_APPROX_DP,
-			    POLY_APPROX_PRECISION, 0);
+			    POLY_APPROX_PRECISION, 1);
 	
 	return poly;
 }
@@ -215,70 +328,41 @@ static CvSeq *contour_approximation (CvSeq *contour)
  * \param[in]   fourier descriptors vector 
  * \param[in]   array of posture models
  * \param[in]   number of posture models
+ * \param[out]  distance to the nearest model
  * \return      classification index 
  */
-static int fd_argmin_distance (CvMat *fd, CvPostModel *mo, int num)
+static int fd_argmin_distance (CvMat *fd, CvPostModel *mo, int num,
+			       double *dist)
 {
 	int i, argmin=0;
-	double min=1e6;
+	double min=DBL_MAX;
 
 	for (i=0; i<num; i++) {
-		double dist;
+		double d;
 		
-		dist = cvMahalanobis(fd, mo[i].mean, mo[i].cov);
+		d = cvMahalanobis(fd, mo[i].mean, mo[i].cov);
 
-		if (dist < min) {
-			min = dist;
+		if (d < min) {
+			min = d;
 			argmin = i;
 		}
 	}
+	*dist = min;
 
 	return argmin;
 }
 
 /*!
- * \brief Majority decision respect a number of classifications.
+ * \brief Confidence of a model classification.
  *
- * This implents a buffer of posture classifications, to make a
- * classification more stable and filter out some errors due to
- * noise. The current classification is done using BUFFLEN previous
- * classifications and the value is the one which appears more times
- * in the buffer.
+ * Used to weight the votes of the advanced classification when the
+ * voter is weighted: 1 on the model mean, decreasing with the
+ * Mahalanobis distance.
  *
- * \param[in]   posture index
- * \param[in]   number of different postures
- * \return      classification index 
+ * \param[in]   distance to the nearest model
+ * \return      confidence in (0,1]
  */
-int majority_classification (int p, int num)
+static double confidence (double dist)
 {
-	static int buffer[BUFFLEN];
-	static int count=0;
-	int *asd;
-
-	asd = (int*)malloc(sizeof(int) * num);
-	memset(asd, 0, sizeof(int)*num);
-
-	if (count < BUFFLEN) {
-		buffer[count++] = p;
-		return -1;
-	} else {
-		int i,argmax=-1,max=-1;
-
-		memcpy(buffer, buffer+1, sizeof(int)*BUFFLEN-1);
-		buffer[BUFFLEN-1] = p;
-
-		for (i=0; i<BUFFLEN; i++) {
-			asd[buffer[i]]++;
-		}
-		for (i=0; i<num; i++) {
-			if (asd[i] > max) {
-				max = asd[i];
-				argmax=i;
-			}
-		}
-
-		free(asd);
-
-		return argmax;
-	}
+	return 1.0 / (1.0 + dist);
 }
@@ -10,8 +10,27 @@ typedef struct CvPostModel {
 	CvMat *cov;    //!< covariance matrix 
 } CvPostModel;
 
+/*!
+ * \brief Compiled set of posture models (see models.c).
+ */
+typedef struct CvPostModelSet {
+	int num;       //!< number of models
+	int pairs;     //!< number of model pairs in data
+	int *type;     //!< model ids
+	double *data;  //!< means and Cholesky factors (aligned)
+} CvPostModelSet;
+
 int        basic_posture_classification        (CvSeq*);
 int        advanced_posture_classification     (CvSeq*, CvPostModel*, int);
+int        basic_posture_classification_ctx    (xkin_ctx*, xkin_contour*);
+int        advanced_posture_classification_ctx (xkin_ctx*, xkin_contour*,
+						CvPostModel*, int);
+int        advanced_posture_classification_set (CvSeq*, CvPostModelSet*,
+						double*);
+int        advanced_posture_classification_set_ctx (xkin_ctx*,
+						    xkin_contour*,
+						    CvPostModelSet*,
+						    double*);
 
 #endif /* _POSTURE_H_ */
 
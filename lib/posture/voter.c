@@ -0,0 +1,167 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file voter.c
+ * \author Fabrizio Pedersoli
+ *
+ * Temporal voting of the posture classifications.
+ *
+ * Each frame one vote enters the ring and, once the window is full,
+ * the oldest one leaves: the class scores are updated by the two
+ * votes only. The leader is kept as long as no other class gets a
+ * higher score; the scores are scanned only when the vote leaving is
+ * one of the leader's, since only then another class can overtake it
+ * without receiving a vote. The scores are allocated when the number
+ * of classes grows, not per frame.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libxkin.h"
+#include "voter.h"
+
+
+static void        voter_reset         (xkin_voter*, int, int);
+static void        voter_rescan        (xkin_voter*);
+
+
+/*!
+ * \brief Make room for the scores of num classes.
+ *
+ * The scores are enlarged only if needed, keeping the votes in the
+ * window.
+ *
+ * \param[in]   voter
+ * \param[in]   number of classes
+ * \return      1 if memory has been allocated, 0 otherwise
+ */
+int voter_reserve (xkin_voter *v, int num)
+{
+	if (num <= v->capacity)
+		return 0;
+
+	v->score = (double*)realloc(v->score, sizeof(double) * num);
+	memset(v->score + v->capacity, 0,
+	       sizeof(double) * (num - v->capacity));
+	v->capacity = num;
+
+	return 1;
+}
+
+/*!
+ * \brief Vote a classification.
+ *
+ * Room for the class must have been made with voter_reserve.
+ *
+ * \param[in]   voter
+ * \param[in]   classification index
+ * \param[in]   confidence of the classification (used if weighted)
+ * \return      voted index, -1 until the window is full or if the
+ *              index is not a class
+ */
+int voter_update (xkin_voter *v, int p, double conf)
+{
+	int len, slot, out=-1;
+	double w;
+
+	if (p < 0 || p >= v->capacity)
+		return -1;
+
+	len = (v->window <= 0) ? XKIN_BUFFLEN : v->window;
+	if (len > XKIN_VOTE_WINDOW)
+		len = XKIN_VOTE_WINDOW;
+	if (len != v->len || v->weighted != v->mode)
+		voter_reset(v, len, v->weighted);
+
+	if (v->count == len) {
+		slot = v->head;
+		out = v->votes[slot];
+		v->score[out] -= v->weight[slot];
+		v->head = (v->head+1 < len) ? v->head+1 : 0;
+	} else {
+		slot = v->head + v->count++;
+		if (slot >= len)
+			slot -= len;
+	}
+
+	w = v->mode ? conf : 1.0;
+	v->votes[slot] = p;
+	v->weight[slot] = w;
+	v->score[p] += w;
+	if (p >= v->classes)
+		v->classes = p+1;
+
+	if (out == v->leader) {
+		voter_rescan(v);
+	} else if (v->score[p] > v->score[v->leader]) {
+		v->leader = p;
+	}
+
+	return (v->count < len) ? -1 : v->leader;
+}
+
+/*!
+ * \brief Empty the voter.
+ *
+ * \param[in]  voter
+ * \param[in]  window length
+ * \param[in]  weighting
+ */
+static void voter_reset (xkin_voter *v, int len, int mode)
+{
+	memset(v->score, 0, sizeof(double) * v->capacity);
+	v->len = len;
+	v->mode = mode;
+	v->head = 0;
+	v->count = 0;
+	v->classes = 0;
+	v->leader = 0;
+}
+
+/*!
+ * \brief Find the leader after it lost a vote.
+ *
+ * On ties the current leader is kept, then the lowest index.
+ *
+ * \param[in]  voter
+ */
+static void voter_rescan (xkin_voter *v)
+{
+	int i;
+
+	for (i=0; i<v->classes; i++) {
+		if (v->score[i] > v->score[v->leader])
+			v->leader = i;
+	}
+}
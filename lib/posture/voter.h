@@ -0,0 +1,7 @@
+#ifndef _VOTER_H_
+#define _VOTER_H_
+
+int        voter_reserve       (xkin_voter *v, int num);
+int        voter_update        (xkin_voter *v, int p, double conf);
+
+#endif /* _VOTER_H_ */
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file arena.c
+ * \author Fabrizio Pedersoli
+ *
+ * Per context frame memory. Scratch buffers whose size changes from
+ * frame to frame are taken from an arena that is reset at every
+ * frame, buffers of fixed size are created once. Every heap
+ * allocation done on behalf of a context is counted in ctx->allocs,
+ * with XKIN_DEBUG_ALLOC defined xkin_ctx_frame reports on stderr the
+ * frames after the warm-up that allocated. Allocations can still be
+ * legitimate then (a larger hand ROI grows the arena, tables are
+ * created on first use), they should just not repeat.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+
+
+#define ARENA_ALIGN     16
+
+/*!
+ * \brief Arena overflow block, freed at the next frame.
+ */
+typedef struct arena_block {
+	struct arena_block *next;
+} arena_block;
+
+
+/*!
+ * \brief Start a new frame.
+ *
+ * The arena is emptied, if the last frame did not fit in it the
+ * arena is enlarged to the largest frame seen so far.
+ *
+ * \param[in]  pipeline context
+ */
+void xkin_ctx_frame (xkin_ctx *ctx)
+{
+	xkin_arena *a = &(ctx->arena);
+
+#ifdef XKIN_DEBUG_ALLOC
+	if (ctx->frames > XKIN_WARMUP_FRAMES && ctx->allocs != ctx->allocs_mark)
+		fprintf(stderr, "xkin: %lu heap allocations in frame %lu\n",
+			ctx->allocs - ctx->allocs_mark, ctx->frames);
+#endif
+
+	while (a->extra != NULL) {
+		arena_block *b = (arena_block*)a->extra;
+
+		a->extra = b->next;
+		free(b);
+	}
+
+	if (a->peak > a->size) {
+		free(a->base);
+		a->base = (char*)malloc(a->peak);
+		a->size = a->peak;
+		ctx->allocs++;
+	}
+	a->used = 0;
+
+	ctx->allocs_mark = ctx->allocs;
+	ctx->frames++;
+}
+
+/*!
+ * \brief Allocate frame memory.
+ *
+ * The memory is valid until the next xkin_ctx_frame.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  size in bytes
+ * \return     16 byte aligned memory
+ */
+void *xkin_alloc (xkin_ctx *ctx, size_t size)
+{
+	xkin_arena *a = &(ctx->arena);
+	size_t n = (size + ARENA_ALIGN-1) & ~(size_t)(ARENA_ALIGN-1);
+	void *p;
+
+	if (a->base != NULL && a->used + n <= a->size) {
+		p = a->base + a->used;
+	} else {
+		arena_block *b = (arena_block*)malloc(ARENA_ALIGN + n);
+
+		b->next = (arena_block*)a->extra;
+		a->extra = b;
+		p = (char*)b + ARENA_ALIGN;
+		ctx->allocs++;
+	}
+
+	a->used += n;
+	if (a->used > a->peak)
+		a->peak = a->used;
+
+	return p;
+}
+
+/*!
+ * \brief Create an image in frame memory.
+ *
+ * Header and data are valid until the next xkin_ctx_frame, the image
+ * must not be released.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  image size
+ * \param[in]  pixel depth
+ * \param[in]  number of channels
+ * \return     image
+ */
+IplImage *xkin_alloc_image (xkin_ctx *ctx, CvSize size, int depth, int channels)
+{
+	IplImage *img = (IplImage*)xkin_alloc(ctx, sizeof(IplImage));
+
+	cvInitImageHeader(img, size, depth, channels, IPL_ORIGIN_TL, 4);
+	cvSetData(img, xkin_alloc(ctx, img->imageSize), img->widthStep);
+
+	return img;
+}
+
+/*!
+ * \brief Create a persistent image once.
+ *
+ * The image is created if it does not exist or it has a different
+ * size or format, otherwise it is returned as it is.
+ *
+ * \param[in]      pipeline context
+ * \param[in,out]  image
+ * \param[in]      image size
+ * \param[in]      pixel depth
+ * \param[in]      number of channels
+ * \return         image
+ */
+IplImage *xkin_image (xkin_ctx *ctx, IplImage **img, CvSize size, int depth,
+		      int channels)
+{
+	if (*img != NULL && ((*img)->width != size.width ||
+			     (*img)->height != size.height ||
+			     (*img)->depth != depth ||
+			     (*img)->nChannels != channels))
+		cvReleaseImage(img);
+
+	if (*img == NULL) {
+		*img = cvCreateImage(size, depth, channels);
+		ctx->allocs++;
+	}
+
+	return *img;
+}
+
+/*!
+ * \brief Free the arena memory.
+ *
+ * \param[in]  arena
+ */
+void xkin_arena_free (xkin_arena *a)
+{
+	while (a->extra != NULL) {
+		arena_block *b = (arena_block*)a->extra;
+
+		a->extra = b->next;
+		free(b);
+	}
+	free(a->base);
+	a->base = NULL;
+	a->size = a->used = a->peak = 0;
+}
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file contour.c
+ * \author Fabrizio Pedersoli
+ *
+ * Flat contour type. The points of a contour are stored as two
+ * contiguous arrays of coordinates (x[] and y[]); the buffers grow
+ * when needed and are reused from frame to frame.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+
+
+/*!
+ * \brief Make room for a number of points.
+ *
+ * The content is not preserved when the buffer grows.
+ *
+ * \param[in,out]  contour
+ * \param[in]      number of points
+ * \return         1 if memory has been allocated, 0 otherwise
+ */
+int xkin_contour_reserve (xkin_contour *c, int num)
+{
+	int cap;
+
+	if (num <= c->capacity)
+		return 0;
+
+	for (cap = c->capacity > 0 ? c->capacity : 256; cap < num; cap *= 2)
+		;
+
+	free(c->x);
+	free(c->y);
+	c->x = (int*)malloc(sizeof(int) * cap);
+	c->y = (int*)malloc(sizeof(int) * cap);
+	c->capacity = cap;
+
+	return 1;
+}
+
+/*!
+ * \brief Copy the points of a sequence in a contour.
+ *
+ * \param[out]  contour
+ * \param[in]   sequence of CvPoint
+ * \return      1 if memory has been allocated, 0 otherwise
+ */
+int xkin_contour_from_seq (xkin_contour *c, CvSeq *seq)
+{
+	CvSeqReader reader;
+	int i, alloc;
+
+	alloc = xkin_contour_reserve(c, seq->total);
+
+	cvStartReadSeq(seq, &reader, 0);
+	for (i=0; i<seq->total; i++) {
+		CvPoint p;
+
+		CV_READ_SEQ_ELEM(p, reader);
+		c->x[i] = p.x;
+		c->y[i] = p.y;
+	}
+	c->num = seq->total;
+
+	return alloc;
+}
+
+/*!
+ * \brief Copy a contour in a new sequence.
+ *
+ * \param[in]  contour
+ * \param[in]  storage of the sequence
+ * \return     closed sequence of CvPoint
+ */
+CvSeq *xkin_contour_to_seq (xkin_contour *c, CvMemStorage *storage)
+{
+	CvSeq *seq;
+	int i;
+
+	seq = cvCreateSeq(CV_SEQ_ELTYPE_POINT | CV_SEQ_FLAG_CLOSED,
+			  sizeof(CvContour), sizeof(CvPoint), storage);
+	for (i=0; i<c->num; i++) {
+		CvPoint p = cvPoint(c->x[i], c->y[i]);
+
+		cvSeqPush(seq, &p);
+	}
+
+	return seq;
+}
+
+/*!
+ * \brief Write the points of a contour interleaved.
+ *
+ * This is the form opencv functions accept, wrap it with
+ * cvMat(1, c->num, CV_32SC2, pts).
+ *
+ * \param[in]   contour
+ * \param[out]  points (c->num elements)
+ */
+void xkin_contour_points (xkin_contour *c, CvPoint *pts)
+{
+	int i;
+
+	for (i=0; i<c->num; i++) {
+		pts[i].x = c->x[i];
+		pts[i].y = c->y[i];
+	}
+}
+
+/*!
+ * \brief Bounding box of a contour (as cvBoundingRect).
+ *
+ * \param[in]  contour
+ * \return     bounding box
+ */
+CvRect xkin_contour_bbox (xkin_contour *c)
+{
+	int i, x0, y0, x1, y1;
+
+	if (c->num == 0)
+		return cvRect(0, 0, 0, 0);
+
+	x0 = x1 = c->x[0];
+	y0 = y1 = c->y[0];
+	for (i=1; i<c->num; i++) {
+		if (c->x[i] < x0) x0 = c->x[i];
+		if (c->x[i] > x1) x1 = c->x[i];
+		if (c->y[i] < y0) y0 = c->y[i];
+		if (c->y[i] > y1) y1 = c->y[i];
+	}
+
+	return cvRect(x0, y0, x1-x0+1, y1-y0+1);
+}
+
+/*!
+ * \brief Free the contour buffers.
+ *
+ * \param[in]  contour
+ */
+void xkin_contour_free (xkin_contour *c)
+{
+	free(c->x);
+	free(c->y);
+	c->x = c->y = NULL;
+	c->num = c->capacity = 0;
+}
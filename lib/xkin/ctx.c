@@ -0,0 +1,200 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file ctx.c
+ * \author Fabrizio Pedersoli
+ *
+ * This file contains the pipeline context management. A context owns
+ * all the working images, storages and state machines used by body,
+ * hand, posture and gesture functions for a single stream.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <opencv2/core/core_c.h>
+#include <opencv2/imgproc/imgproc_c.h>
+
+#include "libxkin.h"
+
+
+static void        release_body          (xkin_body*);
+static void        release_hand          (xkin_hand*);
+static void        release_posture       (xkin_posture*);
+
+
+/*!
+ * \brief Create an empty pipeline context.
+ *
+ * All the buffers are allocated by the first frame processed with
+ * this context, parameters are set to their default values.
+ *
+ * \return  pipeline context
+ */
+xkin_ctx *xkin_ctx_create (void)
+{
+	xkin_ctx *ctx;
+
+	ctx = (xkin_ctx*)calloc(1, sizeof(xkin_ctx));
+	if (ctx == NULL)
+		return NULL;
+
+	ctx->body.min_area = XKIN_BODY_MIN_AREA;
+
+	return ctx;
+}
+
+/*!
+ * \brief Destroy a pipeline context (free memory).
+ *
+ * \param[in]  pipeline context
+ */
+void xkin_ctx_free (xkin_ctx *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	xkin_pool_free(ctx->pool);
+	xkin_arena_free(&(ctx->arena));
+	release_body(&(ctx->body));
+	release_hand(&(ctx->hand));
+	release_posture(&(ctx->posture));
+
+	free(ctx);
+}
+
+/*!
+ * \brief Process wide context.
+ *
+ * This is the context used by the functions without the _ctx suffix,
+ * it is not meant to be shared between threads.
+ *
+ * \return  default pipeline context
+ */
+xkin_ctx *xkin_default_ctx (void)
+{
+	static xkin_ctx *ctx = NULL;
+
+	if (ctx == NULL)
+		ctx = xkin_ctx_create();
+
+	return ctx;
+}
+
+/*!
+ * \brief Set the number of threads used to process a frame.
+ *
+ * The worker pool is created here once and kept by the context, with
+ * num <= 1 the processing is single threaded.
+ *
+ * \param[in]  pipeline context
+ * \param[in]  number of threads (at most XKIN_MAX_THREADS)
+ * \return     number of threads actually used
+ */
+int xkin_ctx_set_threads (xkin_ctx *ctx, int num)
+{
+	if (num > XKIN_MAX_THREADS)
+		num = XKIN_MAX_THREADS;
+
+	if (num == xkin_pool_size(ctx->pool))
+		return num;
+
+	xkin_pool_free(ctx->pool);
+	ctx->pool = xkin_pool_create(num);
+
+	return xkin_pool_size(ctx->pool);
+}
+
+static void release_body (xkin_body *s)
+{
+	if (s->body != NULL)
+		cvReleaseImage(&(s->body));
+	if (s->tmp != NULL)
+		cvReleaseImage(&(s->tmp));
+	if (s->coarse != NULL)
+		cvReleaseImage(&(s->coarse));
+	if (s->bg_min != NULL)
+		cvReleaseImage(&(s->bg_min));
+	if (s->bg_max != NULL)
+		cvReleaseImage(&(s->bg_max));
+	if (s->fg != NULL)
+		cvReleaseImage(&(s->fg));
+	if (s->labels != NULL)
+		cvReleaseImage(&(s->labels));
+	if (s->user != NULL)
+		cvReleaseImage(&(s->user));
+	free(s->tiles);
+	s->tiles = NULL;
+}
+
+static void release_hand (xkin_hand *s)
+{
+	int i;
+
+	if (s->hand != NULL)
+		cvReleaseImage(&(s->hand));
+	if (s->work != NULL)
+		cvReleaseImage(&(s->work));
+	if (s->strel != NULL)
+		cvReleaseStructuringElement(&(s->strel));
+	if (s->storage != NULL)
+		cvReleaseMemStorage(&(s->storage));
+	xkin_contour_free(&(s->contour));
+	free(s->skin_lut);
+	s->skin_lut = NULL;
+	for (i=0; i<XKIN_REG_TABLES; i++) {
+		free(s->reg.lut[i]);
+		s->reg.lut[i] = NULL;
+	}
+	free(s->mask.bits);
+	free(s->mask.scratch);
+	s->mask.bits = s->mask.scratch = NULL;
+}
+
+static void release_posture (xkin_posture *s)
+{
+	if (s->poly != NULL)
+		cvReleaseMemStorage(&(s->poly));
+	if (s->hull != NULL)
+		cvReleaseMemStorage(&(s->hull));
+	if (s->defects != NULL)
+		cvReleaseMemStorage(&(s->defects));
+	xkin_contour_free(&(s->input));
+	free(s->basic.score);
+	free(s->advanced.score);
+	if (s->fft != NULL)
+		s->fft_free(s->fft);
+	s->fft = NULL;
+	if (s->desc != NULL)
+		cvReleaseMat(&(s->desc));
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file pool.c
+ * \author Fabrizio Pedersoli
+ *
+ * Fixed size worker pool. The workers are created once and then used
+ * to run the tiles of a frame: xkin_pool_run executes task(arg, i)
+ * for every i in [0,num) and returns when all of them are done. The
+ * calling thread takes part in the work.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "libxkin.h"
+
+
+struct xkin_pool {
+	pthread_t *threads;      //!< worker threads
+	int num;                 //!< number of workers
+	pthread_mutex_t lock;
+	pthread_cond_t start;    //!< signaled when a new run begins
+	pthread_cond_t done;     //!< signaled when the last job ends
+	xkin_task task;          //!< current task
+	void *arg;               //!< current task argument
+	int jobs;                //!< number of jobs of the run
+	int next;                //!< next job to pick
+	int pending;             //!< jobs not yet finished
+	unsigned int gen;        //!< run counter
+	int quit;
+};
+
+
+static void*       worker         (void*);
+static void        run_jobs       (xkin_pool*);
+
+
+/*!
+ * \brief Create a pool.
+ *
+ * \param[in]  number of threads that run the jobs (the caller included)
+ * \return     pool, NULL if num < 2 or on error
+ */
+xkin_pool *xkin_pool_create (int num)
+{
+	xkin_pool *p;
+	int i;
+
+	if (num < 2)
+		return NULL;
+
+	p = (xkin_pool*)calloc(1, sizeof(xkin_pool));
+	p->threads = (pthread_t*)malloc(sizeof(pthread_t) * (num-1));
+	pthread_mutex_init(&(p->lock), NULL);
+	pthread_cond_init(&(p->start), NULL);
+	pthread_cond_init(&(p->done), NULL);
+
+	for (i=0; i<num-1; i++) {
+		if (pthread_create(&(p->threads[i]), NULL, worker, p) != 0)
+			break;
+		p->num++;
+	}
+
+	if (p->num == 0) {
+		xkin_pool_free(p);
+		return NULL;
+	}
+
+	return p;
+}
+
+/*!
+ * \brief Destroy a pool (join the workers and free memory).
+ *
+ * \param[in]  pool
+ */
+void xkin_pool_free (xkin_pool *p)
+{
+	int i;
+
+	if (p == NULL)
+		return;
+
+	pthread_mutex_lock(&(p->lock));
+	p->quit = 1;
+	pthread_cond_broadcast(&(p->start));
+	pthread_mutex_unlock(&(p->lock));
+
+	for (i=0; i<p->num; i++) {
+		pthread_join(p->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&(p->done));
+	pthread_cond_destroy(&(p->start));
+	pthread_mutex_destroy(&(p->lock));
+	free(p->threads);
+	free(p);
+}
+
+/*!
+ * \brief Number of threads of the pool (the caller included).
+ *
+ * \param[in]  pool
+ * \return     number of threads, 1 for a NULL pool
+ */
+int xkin_pool_size (xkin_pool *p)
+{
+	return p == NULL ? 1 : p->num + 1;
+}
+
+/*!
+ * \brief Run a task num times and wait for completion.
+ *
+ * With a NULL pool the jobs are run by the caller.
+ *
+ * \param[in]  pool
+ * \param[in]  task
+ * \param[in]  task argument
+ * \param[in]  number of jobs
+ */
+void xkin_pool_run (xkin_pool *p, xkin_task task, void *arg, int num)
+{
+	int i;
+
+	if (p == NULL) {
+		for (i=0; i<num; i++) {
+			task(arg, i);
+		}
+		return;
+	}
+
+	pthread_mutex_lock(&(p->lock));
+	p->task = task;
+	p->arg = arg;
+	p->jobs = num;
+	p->next = 0;
+	p->pending = num;
+	p->gen++;
+	pthread_cond_broadcast(&(p->start));
+
+	run_jobs(p);
+	while (p->pending > 0) {
+		pthread_cond_wait(&(p->done), &(p->lock));
+	}
+	pthread_mutex_unlock(&(p->lock));
+}
+
+/*!
+ * \brief Pick and run jobs until none is left (lock held on entry
+ * and exit).
+ */
+static void run_jobs (xkin_pool *p)
+{
+	while (p->next < p->jobs) {
+		int i = p->next++;
+
+		pthread_mutex_unlock(&(p->lock));
+		p->task(p->arg, i);
+		pthread_mutex_lock(&(p->lock));
+
+		if (--p->pending == 0)
+			pthread_cond_signal(&(p->done));
+	}
+}
+
+static void *worker (void *arg)
+{
+	xkin_pool *p = (xkin_pool*)arg;
+	unsigned int seen = 0;
+
+	pthread_mutex_lock(&(p->lock));
+	for (;;) {
+		while (p->gen == seen && !p->quit) {
+			pthread_cond_wait(&(p->start), &(p->lock));
+		}
+		if (p->quit)
+			break;
+
+		seen = p->gen;
+		run_jobs(p);
+	}
+	pthread_mutex_unlock(&(p->lock));
+
+	return NULL;
+}
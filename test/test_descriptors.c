@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file test_descriptors.c
+ * \author Fabrizio Pedersoli
+ *
+ * The direct DFT descriptors (XKIN_FD_DIRECT) against the FFTW ones
+ * (XKIN_FD_FFTW) on random star shaped contours. Built with FFTW only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+#include "libposture.h"
+
+#define CONTOURS 50
+#define TOL 1e-9
+
+
+static void        star_contour   (xkin_contour*);
+
+
+int main (void)
+{
+	xkin_ctx *ctx = xkin_ctx_create();
+	xkin_contour cnt = {NULL, NULL, 0, 0};
+	double err = 0;
+	int i, j;
+
+	srand(1);
+
+	for (i=0; i<CONTOURS; i++) {
+		double ref[FD_NUM];
+		CvMat *fd;
+
+		xkin_ctx_frame(ctx);
+		star_contour(&cnt);
+
+		ctx->posture.descriptors = XKIN_FD_FFTW;
+		fd = get_fourier_descriptors_ctx(ctx, &cnt);
+		for (j=0; j<FD_NUM; j++)
+			ref[j] = cvmGet(fd, 0, j);
+
+		ctx->posture.descriptors = XKIN_FD_DIRECT;
+		fd = get_fourier_descriptors_ctx(ctx, &cnt);
+		for (j=0; j<FD_NUM; j++) {
+			double e = fabs(cvmGet(fd, 0, j) - ref[j]) /
+				(fabs(ref[j]) > 1 ? fabs(ref[j]) : 1);
+
+			if (e > err)
+				err = e;
+		}
+	}
+
+	printf("largest relative difference %g\n", err);
+
+	xkin_contour_free(&cnt);
+	xkin_ctx_free(ctx);
+
+	return err > TOL;
+}
+
+/*!
+ * \brief Random closed star shaped contour.
+ *
+ * \param[out]  contour
+ */
+static void star_contour (xkin_contour *cnt)
+{
+	int i, num = 50 + rand() % 400;
+	double r0 = 40 + rand() % 60;
+
+	xkin_contour_reserve(cnt, num);
+	for (i=0; i<num; i++) {
+		double a = 2*CV_PI*i/num;
+		double r = r0 * (1 + 0.3*sin(5*a + rand()%7)) + rand()%5;
+
+		cnt->x[i] = 320 + (int)(r*cos(a));
+		cnt->y[i] = 240 + (int)(r*sin(a));
+	}
+	cnt->num = num;
+}
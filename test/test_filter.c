@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file test_filter.c
+ * \author Fabrizio Pedersoli
+ *
+ * Accuracy of the 7x7 filters of the color hand ROI against the
+ * cvSmooth calls they replace, on random and smooth images of edge
+ * sizes (smaller than the kernel, one vector wide, odd). The median
+ * must be exact, the Gaussian within one gray level.
+ *
+ * Built twice: linked to the hand library (SSE2 when available) and
+ * with filter.c compiled without SSE2 (filter_scalar.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <opencv2/core/core_c.h>
+#include <opencv2/imgproc/imgproc_c.h>
+
+#include "libxkin.h"
+#include "hand/filter.h"
+
+#define GAUSS_TOL 1
+
+
+static void        fill_image     (IplImage*, int);
+static int         max_diff       (IplImage*, IplImage*);
+
+
+int main (void)
+{
+	const int size[][2] = {{97,61}, {8,8}, {5,4}, {16,3}, {333,7},
+			       {1,9}, {640,480}};
+	xkin_ctx *ctx = xkin_ctx_create();
+	int i, kind, fail = 0;
+
+	srand(1);
+
+	for (i=0; i<(int)(sizeof(size)/sizeof(size[0])); i++) {
+		for (kind=0; kind<2; kind++) {
+			CvSize s = cvSize(size[i][0], size[i][1]);
+			IplImage *src = cvCreateImage(s, 8, 1);
+			IplImage *ref = cvCreateImage(s, 8, 1);
+			IplImage *out = cvCreateImage(s, 8, 1);
+			int dg, dm;
+
+			xkin_ctx_frame(ctx);
+			fill_image(src, kind);
+
+			cvSmooth(src, ref, CV_GAUSSIAN, 7, 7, 0, 0);
+			filter_gaussian7(ctx, src, out);
+			dg = max_diff(ref, out);
+
+			cvSmooth(src, ref, CV_MEDIAN, 7, 7, 0, 0);
+			cvCopy(src, out, NULL);
+			filter_median7(ctx, out, out);
+			dm = max_diff(ref, out);
+
+			printf("%dx%d %s: gaussian %d, median %d\n", s.width,
+			       s.height, kind ? "smooth" : "random", dg, dm);
+			if (dg > GAUSS_TOL || dm > 0)
+				fail = 1;
+
+			cvReleaseImage(&src);
+			cvReleaseImage(&ref);
+			cvReleaseImage(&out);
+		}
+	}
+
+	xkin_ctx_free(ctx);
+
+	return fail;
+}
+
+/*!
+ * \brief Fill an image with noise or with a noisy smooth pattern.
+ *
+ * \param[out]  image
+ * \param[in]   0 uniform noise, 1 smooth pattern
+ */
+static void fill_image (IplImage *img, int kind)
+{
+	int x, y;
+
+	for (y=0; y<img->height; y++) {
+		unsigned char *p = (unsigned char*)img->imageData +
+			y*img->widthStep;
+
+		for (x=0; x<img->width; x++) {
+			int v = rand() % 256;
+
+			if (kind)
+				v = 128 + 100*sin(x/9.)*cos(y/7.) + v/16 - 8;
+			p[x] = v < 0 ? 0 : (v > 255 ? 255 : v);
+		}
+	}
+}
+
+/*!
+ * \brief Largest absolute difference between two images.
+ */
+static int max_diff (IplImage *a, IplImage *b)
+{
+	int x, y, m = 0;
+
+	for (y=0; y<a->height; y++) {
+		unsigned char *p = (unsigned char*)a->imageData + y*a->widthStep;
+		unsigned char *q = (unsigned char*)b->imageData + y*b->widthStep;
+
+		for (x=0; x<a->width; x++) {
+			int d = abs(p[x] - q[x]);
+
+			if (d > m)
+				m = d;
+		}
+	}
+
+	return m;
+}
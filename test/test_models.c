@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file test_models.c
+ * \author Fabrizio Pedersoli
+ *
+ * The compiled posture model set against cvMahalanobis on random
+ * models (inverse covariances A A' + 0.3 I): the nearest model and its
+ * distance must be the same for random descriptors. A matrix that is
+ * not positive definite must make the compilation fail.
+ *
+ * Built twice: linked to the posture library (SSE2 when available)
+ * and with models.c compiled without SSE2 (models_scalar.c).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+#include "posture/const.h"
+#include "posture/posture.h"
+#include "posture/models.h"
+
+#define QUERIES 2000
+#define TOL 1e-9
+
+
+static void        random_models    (CvPostModel*, int);
+static void        release_models   (CvPostModel*, int);
+static double      rnd              (void);
+
+
+int main (void)
+{
+	const int sizes[] = {1, 2, 5, 60};
+	CvMat *fd = cvCreateMat(1, FD_NUM, CV_64FC1);
+	int i, q, k, j, fail = 0;
+
+	srand(1);
+
+	for (k=0; k<(int)(sizeof(sizes)/sizeof(sizes[0])); k++) {
+		int num = sizes[k], bad = 0;
+		CvPostModel *mo = (CvPostModel*)malloc(sizeof(CvPostModel)*num);
+		CvPostModelSet *set;
+
+		random_models(mo, num);
+		set = posture_models_compile(mo, num);
+		if (set == NULL) {
+			printf("%d models: compilation failed\n", num);
+			return 1;
+		}
+
+		for (q=0; q<QUERIES; q++) {
+			double min = DBL_MAX, dist;
+			int argmin = 0, p;
+
+			for (j=0; j<FD_NUM; j++)
+				cvmSet(fd, 0, j, 3*rnd());
+
+			for (i=0; i<num; i++) {
+				double d = cvMahalanobis(fd, mo[i].mean, mo[i].cov);
+
+				if (d < min) {
+					min = d;
+					argmin = i;
+				}
+			}
+
+			p = posture_models_classify(set, fd, &dist);
+			if (p != argmin || fabs(dist - min) > TOL * min)
+				bad++;
+		}
+
+		printf("%d models: %d mismatches\n", num, bad);
+		if (bad)
+			fail = 1;
+
+		/* not positive definite */
+		cvmSet(mo[0].cov, 0, 0, -1);
+		if (posture_models_compile(mo, num) != NULL) {
+			printf("%d models: indefinite matrix accepted\n", num);
+			fail = 1;
+		}
+
+		posture_models_release(&set);
+		release_models(mo, num);
+		free(mo);
+	}
+
+	cvReleaseMat(&fd);
+
+	return fail;
+}
+
+/*!
+ * \brief Random models with positive definite inverse covariances.
+ */
+static void random_models (CvPostModel *mo, int num)
+{
+	CvMat *a = cvCreateMat(FD_NUM, FD_NUM, CV_64FC1);
+	int i, j, k;
+
+	for (i=0; i<num; i++) {
+		mo[i].type = i;
+		mo[i].mean = cvCreateMat(1, FD_NUM, CV_64FC1);
+		mo[i].cov = cvCreateMat(FD_NUM, FD_NUM, CV_64FC1);
+
+		for (j=0; j<FD_NUM; j++) {
+			cvmSet(mo[i].mean, 0, j, 2*rnd());
+			for (k=0; k<FD_NUM; k++)
+				cvmSet(a, j, k, rnd());
+		}
+		cvMulTransposed(a, mo[i].cov, 0, NULL, 1);
+		for (j=0; j<FD_NUM; j++)
+			cvmSet(mo[i].cov, j, j, cvmGet(mo[i].cov, j, j) + 0.3);
+	}
+
+	cvReleaseMat(&a);
+}
+
+static void release_models (CvPostModel *mo, int num)
+{
+	int i;
+
+	for (i=0; i<num; i++) {
+		cvReleaseMat(&(mo[i].mean));
+		cvReleaseMat(&(mo[i].cov));
+	}
+}
+
+static double rnd (void)
+{
+	return (double)rand() / RAND_MAX - 0.5;
+}
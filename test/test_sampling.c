@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file test_sampling.c
+ * \author Fabrizio Pedersoli
+ *
+ * The arc length contour resampler against a reference built on the
+ * cumulative perimeter, on random contours (repeated points included)
+ * and on a square given with different point spacings, which must
+ * give the same samples.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+#include "posture/const.h"
+#include "posture/fourierdesc.h"
+
+#define TOL 1e-9
+
+
+static void        reference      (xkin_contour*, double*, int);
+static double      max_diff       (const double*, const double*, int);
+static void        square         (xkin_contour*, int);
+
+
+int main (void)
+{
+	const int sizes[] = {1, 2, 3, 50, 300, 1000};
+	xkin_contour cnt = {NULL, NULL, 0, 0};
+	double z[2*SAMPLES_NUM], ref[2*SAMPLES_NUM], err, sq;
+	int i, j, fail = 0;
+
+	srand(1);
+
+	for (i=0; i<(int)(sizeof(sizes)/sizeof(sizes[0])); i++) {
+		xkin_contour_reserve(&cnt, sizes[i]);
+		for (j=0; j<sizes[i]; j++) {
+			if (j > 0 && j % 7 == 3) {
+				cnt.x[j] = cnt.x[j-1];
+				cnt.y[j] = cnt.y[j-1];
+			} else {
+				cnt.x[j] = rand() % 50;
+				cnt.y[j] = rand() % 50;
+			}
+		}
+		cnt.num = sizes[i];
+
+		contour_sampling(&cnt, z, SAMPLES_NUM);
+		reference(&cnt, ref, SAMPLES_NUM);
+		err = max_diff(z, ref, SAMPLES_NUM);
+
+		printf("%d points: %g\n", sizes[i], err);
+		if (err > TOL)
+			fail = 1;
+	}
+
+	/* the same square with corners only and with every pixel */
+	square(&cnt, 100);
+	contour_sampling(&cnt, ref, SAMPLES_NUM);
+	square(&cnt, 1);
+	contour_sampling(&cnt, z, SAMPLES_NUM);
+	sq = max_diff(z, ref, SAMPLES_NUM);
+
+	printf("square spacing: %g\n", sq);
+	if (sq > TOL)
+		fail = 1;
+
+	xkin_contour_free(&cnt);
+
+	return fail;
+}
+
+/*!
+ * \brief Reference resampling: for each sample the segment is found
+ * by a search on the cumulative perimeter.
+ */
+static void reference (xkin_contour *c, double *z, int N)
+{
+	double *cum = (double*)malloc(sizeof(double) * (c->num+1));
+	int i, j;
+
+	cum[0] = 0;
+	for (i=0; i<c->num; i++) {
+		int k = (i+1) % c->num;
+
+		cum[i+1] = cum[i] + hypot(c->x[k] - c->x[i], c->y[k] - c->y[i]);
+	}
+
+	for (j=0; j<N; j++) {
+		double t = j * cum[c->num] / N, a;
+		int k;
+
+		i = 0;
+		while (i < c->num-1 && cum[i+1] <= t)
+			i++;
+		k = (i+1) % c->num;
+		a = (cum[i+1] > cum[i]) ? (t - cum[i]) / (cum[i+1] - cum[i]) : 0;
+		z[2*j] = c->x[i] + a * (c->x[k] - c->x[i]);
+		z[2*j+1] = c->y[i] + a * (c->y[k] - c->y[i]);
+	}
+
+	free(cum);
+}
+
+/*!
+ * \brief 100x100 square, one point every step pixels.
+ */
+static void square (xkin_contour *c, int step)
+{
+	int i, n = 400/step;
+
+	xkin_contour_reserve(c, n);
+	for (i=0; i<n; i++) {
+		int s = i*step, side = s/100, d = s%100;
+
+		c->x[i] = side == 0 ? d : (side == 1 ? 100 : (side == 2 ? 100-d : 0));
+		c->y[i] = side == 0 ? 0 : (side == 1 ? d : (side == 2 ? 100 : 100-d));
+	}
+	c->num = n;
+}
+
+static double max_diff (const double *a, const double *b, int N)
+{
+	double m = 0;
+	int i;
+
+	for (i=0; i<2*N; i++) {
+		if (fabs(a[i] - b[i]) > m)
+			m = fabs(a[i] - b[i]);
+	}
+
+	return m;
+}
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2012, Fabrizio Pedersoli
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ * 
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *     
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in
+ *      the documentation and/or other materials provided with the
+ *      distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*!
+ * \file test_voter.c
+ * \author Fabrizio Pedersoli
+ *
+ * The posture voter against a full recount of the window at every
+ * frame, on random vote sequences for several window lengths, with 2
+ * and 100 classes, with unit and with confidence weights. Weights are
+ * multiples of 1/8 so that the sums are exact in both.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <opencv2/core/core_c.h>
+
+#include "libxkin.h"
+#include "posture/voter.h"
+
+#define FRAMES 20000
+#define CLASSES 100
+
+
+static int         recount      (const int*, const double*, int, int, int,
+				 int);
+
+
+int main (void)
+{
+	const int windows[] = {0, 1, 7, 16, XKIN_VOTE_WINDOW};
+	static int votes[FRAMES];
+	static double conf[FRAMES];
+	int i, w, weighted, fail = 0;
+
+	srand(1);
+
+	for (weighted=0; weighted<2; weighted++) {
+		for (w=0; w<(int)(sizeof(windows)/sizeof(windows[0])); w++) {
+			xkin_voter v;
+			int len = windows[w] ? windows[w] : XKIN_BUFFLEN;
+			int num = windows[w] ? CLASSES : 2;
+			int leader = 0, bad = 0;
+
+			memset(&v, 0, sizeof(v));
+			v.window = windows[w];
+			v.weighted = weighted;
+			voter_reserve(&v, num);
+
+			for (i=0; i<FRAMES; i++) {
+				int p, ref;
+
+				/* a few frequent classes and some noise */
+				votes[i] = (rand() % 3 ? rand() % 4 : rand() % num) % num;
+				conf[i] = (1 + rand() % 8) / 8.0;
+
+				p = voter_update(&v, votes[i], conf[i]);
+				leader = recount(votes, weighted ? conf : NULL, i+1,
+						 len, num, leader);
+				ref = (i+1 < len) ? -1 : leader;
+				if (p != ref)
+					bad++;
+			}
+
+			printf("window %d, %d classes%s: %d mismatches\n", len,
+			       num, weighted ? ", weighted" : "", bad);
+			if (bad)
+				fail = 1;
+			free(v.score);
+		}
+	}
+
+	return fail;
+}
+
+/*!
+ * \brief Leader of the last len votes, ties keep the previous leader
+ * then the lowest class.
+ *
+ * \param[in]  votes
+ * \param[in]  vote weights (NULL for unit weights)
+ * \param[in]  number of votes
+ * \param[in]  window length
+ * \param[in]  number of classes
+ * \param[in]  previous leader
+ * \return     leader
+ */
+static int recount (const int *votes, const double *conf, int n, int len,
+		    int num, int prev)
+{
+	double score[CLASSES];
+	int i, best = prev;
+
+	memset(score, 0, sizeof(score));
+	for (i=(n > len ? n-len : 0); i<n; i++)
+		score[votes[i]] += conf ? conf[i] : 1;
+
+	for (i=0; i<num; i++) {
+		if (score[i] > score[best])
+			best = i;
+	}
+
+	return best;
+}
@@ -71,7 +71,8 @@ int main (int argc, char *argv[])
 		int z, p, g, k;
 
 		depth = freenect_sync_get_depth_cv(0);
-		body = body_detection(depth);
+		if ((body = body_detection(depth)) == NULL)
+			continue;
 		hand = hand_detection(body, &z);
 
 		if (!get_hand_contour_basic(hand, &cnt, &cent))
@@ -85,7 +85,8 @@ int main (int argc, char *argv[])
 		tmp = freenect_sync_get_rgb_cv(0);
 		cvCvtColor(tmp, rgb, CV_BGR2RGB);
 		depth = freenect_sync_get_depth_cv(0);
-		body = body_detection(depth);
+		if ((body = body_detection(depth)) == NULL)
+			continue;
 		hand = hand_detection(body, &z);
 
 		if (!get_hand_contour_advanced(hand, rgb, z, &cnt, NULL))